@@ -0,0 +1,37 @@
+#include <fstream>
+#include <iostream>
+
+#include "../core/canvas.h"
+#include "gflags/gflags.h"
+
+DEFINE_double(max_rms, -1,
+              "exit with status 2 when the RMS difference is larger than "
+              "this; negative only reports");
+
+// Compares two PPM renders, e.g. the double and float builds of the same
+// scene: image_diff a.ppm b.ppm
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    std::cerr << "usage: image_diff <a.ppm> <b.ppm>" << std::endl;
+    return 1;
+  }
+
+  auto read = [](const char* path) {
+    std::ifstream in(path);
+    if (!in) {
+      throw std::runtime_error(std::string("can't open ") + path);
+    }
+    return Canvas::from_ppm(in);
+  };
+  auto a = read(argv[1]);
+  auto b = read(argv[2]);
+
+  auto d = difference(a, b);
+  std::cout << d << " (of " << a.width() * a.height() << ")" << std::endl;
+  if (FLAGS_max_rms >= 0 && d.rms > FLAGS_max_rms) {
+    return 2;
+  }
+  return 0;
+}
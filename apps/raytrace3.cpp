@@ -81,6 +81,7 @@ int main() {
   left->set_material(ml);
   world.add(left);
 
+  world.commit();
   auto canvas = camera.render(world);
   canvas.save("/tmp/raytrace3.ppm");
 }
\ No newline at end of file
@@ -68,6 +68,7 @@ int main() {
   left->set_material(ml);
   world.add(left);
 
+  world.commit();
   auto canvas = camera.render(world);
   canvas.save("/tmp/raytrace4.ppm");
 }
\ No newline at end of file
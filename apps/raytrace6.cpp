@@ -209,6 +209,7 @@ int main() {
 //      frame1, frame2, frame3, mirror_frame, mirror
 //  };
 
+  w.commit();
   auto canvas = camera.render(w);
   canvas.save("/tmp/raytrace6.ppm");
 }
\ No newline at end of file
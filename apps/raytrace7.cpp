@@ -14,9 +14,6 @@
 #include "../shapes/plane.h"
 #include "../shapes/sphere.h"
 #include "../utils/timer.h"
-#include "folly/executors/CPUThreadPoolExecutor.h"
-#include "folly/executors/ThreadedExecutor.h"
-#include "folly/experimental/coro/BlockingWait.h"
 
 auto read_file(std::string_view path) -> std::string {
   constexpr auto read_size = std::size_t{4096};
@@ -69,11 +66,10 @@ int main() {
   }
 
   world.add(group);
+  world.commit();
 
-  //auto ex = folly::ThreadedExecutor();
-  auto ex = folly::CPUThreadPoolExecutor(20);
-  auto task = camera.multi_render_sampled(world, 16);
-  auto canvas = folly::coro::blockingWait(std::move(task).scheduleOn(&ex));
-  //auto canvas = camera.render(world);
+  RenderOptions options;
+  options.samples = 16;
+  auto canvas = camera.render(world, options);
   canvas.save("/tmp/raytrace7.ppm");
 }
\ No newline at end of file
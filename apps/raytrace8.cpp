@@ -15,9 +15,6 @@
 #include "../shapes/plane.h"
 #include "../shapes/sphere.h"
 #include "../utils/timer.h"
-#include "folly/executors/CPUThreadPoolExecutor.h"
-#include "folly/executors/ThreadedExecutor.h"
-#include "folly/experimental/coro/BlockingWait.h"
 
 auto read_file(std::string_view path) -> std::string {
   constexpr auto read_size = std::size_t{4096};
@@ -46,16 +43,14 @@ int main() {
 
   world.set_light(parsed_light);
   world.add(parsed_group);
-//
-//  //auto ex = folly::ThreadedExecutor();
-  //auto ex = folly::CPUThreadPoolExecutor(20);
-  //auto task = parsed_camera->multi_render_sampled(world, 8);
-  //auto canvas = folly::coro::blockingWait(std::move(task).scheduleOn(&ex));
+  world.commit();
 
   std::unique_ptr<Canvas> c;
   {
     Timer render_t("Rendering");
-    auto canvas = parsed_camera->multi_render_sampled_tbb(world,8);
+    RenderOptions options;
+    options.samples = 8;
+    auto canvas = parsed_camera->render(world, options);
     c = std::make_unique<Canvas>(std::move(canvas));
   }
   {
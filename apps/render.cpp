@@ -2,11 +2,15 @@
 // Created by Brian Landers on 2019-01-11.
 //
 
+#include <thread>
+
+#include "../core/bvh.h"
 #include "../core/camera.h"
 #include "../core/canvas.h"
 #include "../core/light.h"
 #include "../core/material.h"
 #include "../core/matrix.h"
+#include "../core/sampler.h"
 #include "../core/tuple.h"
 #include "../core/world.h"
 #include "../importers/obj_file.h"
@@ -16,13 +20,37 @@
 #include "../shapes/sphere.h"
 #include "../utils/timer.h"
 #include "folly/executors/CPUThreadPoolExecutor.h"
-#include "folly/executors/ThreadedExecutor.h"
 #include "folly/experimental/coro/BlockingWait.h"
 #include "gflags/gflags.h"
 
 DEFINE_int32(w, 1600, "image width");
 DEFINE_int32(h, 1200, "image height");
 DEFINE_bool(normalize_model, true, "normalize the model file on import");
+DEFINE_bool(obj_mesh, true, "load OBJ faces into one indexed TriangleMesh");
+DEFINE_bool(flatten, true, "bake group transforms into the leaf shapes");
+DEFINE_uint64(bvh_leaf_size, 4, "max primitives per BVH leaf");
+DEFINE_uint64(bvh_max_depth, 64, "max BVH depth");
+DEFINE_bool(bvh_parallel, true, "build the BVH with TBB tasks");
+DEFINE_uint64(bvh_width, 4, "BVH node width: 2, 4 or 8");
+DEFINE_uint64(packet_size, 8, "primary rays per packet: 1, 4, 8 or 16");
+DEFINE_string(out, "/tmp/render.ppm", "where to write the image");
+DEFINE_uint64(tile_size, 32, "render tile width and height, in pixels");
+DEFINE_string(tile_order, "hilbert", "tile order: scanline, morton or hilbert");
+DEFINE_uint64(threads, 0, "render threads; 0 for one per core");
+DEFINE_uint64(samples, 1, "rays per pixel, or the most with --tolerance");
+DEFINE_double(tolerance, 0,
+              "sample each pixel until the standard error of its color is "
+              "within this; 0 always takes --samples");
+DEFINE_uint64(min_samples, 4, "rays per pixel before --tolerance is checked");
+DEFINE_string(sampler, "sobol",
+              "pixel and light samples: random, stratified, halton, sobol or "
+              "bluenoise");
+DEFINE_uint64(frame, 0, "seeds the sampler; the same frame renders the same "
+              "image on any number of threads");
+DEFINE_bool(tile_timings, false, "print how long every tile took");
+DEFINE_uint64(async_window, 0,
+              "render as a coroutine on a folly thread pool with this many "
+              "tiles in flight; 0 uses the TBB tile scheduler");
 
 auto read_file(std::string_view path) -> std::string {
   constexpr auto read_size = std::size_t{4096};
@@ -64,7 +92,7 @@ int main(int argc, char* argv[]) {
   std::string filename(argv[1]);
 
   std::unique_ptr<File> scene;
-  std::shared_ptr<Group> root;
+  Group* root;  // owned by scene
 
   std::unique_ptr<Camera> camera;
   std::unique_ptr<PointLight> light;
@@ -72,17 +100,20 @@ int main(int argc, char* argv[]) {
   {
     Timer t("Loading scene definition");
     if (filename.ends_with(".obj")) {
-      camera = std::make_unique<Camera>(1600, 1200, PI_3);
+      camera = std::make_unique<Camera>(FLAGS_w, FLAGS_h, PI_3);
       camera->set_transform(view_transform(Tuple::point(0, 1.5, -5),
                                           Tuple::point(0, 1, 0),
                                           Tuple::vector(0, 1, 0)));
 
       light = std::make_unique<PointLight>(Tuple::point(-10, 10, -10), Color(0.8, 0.8, 1));
-      scene = std::make_unique<ObjFile>(filename, FLAGS_normalize_model);
+      scene = std::make_unique<ObjFile>(read_file(filename),
+                                        FLAGS_normalize_model, FLAGS_obj_mesh);
     } else if (filename.ends_with(".pbrt")) {
-      scene = std::make_unique<PBRTFile>(filename, FLAGS_normalize_model);
-      light.reset(scene->light());
-      camera.reset(scene->camera());
+      // the importer allocates its camera and light and leaves them to us
+      auto pbrt = std::make_unique<PBRTFile>(filename, FLAGS_normalize_model);
+      light.reset(pbrt->light());
+      camera.reset(pbrt->camera());
+      scene = std::move(pbrt);
     } else {
       throw std::runtime_error("Unknown file type");
     }
@@ -91,22 +122,57 @@ int main(int argc, char* argv[]) {
 
   {
     Timer t("Optimizing model");
-    root->divide(50);
-    std::cout << "Size after divide(): " << root->size(/* recurse */ true)
-              << std::endl;
+    BVHBuildOptions options;
+    options.leaf_size = FLAGS_bvh_leaf_size;
+    options.max_depth = FLAGS_bvh_max_depth;
+    options.parallel = FLAGS_bvh_parallel;
+    if (FLAGS_flatten) {
+      root->flatten();
+    }
+    auto stats = BVHBuilder(options).build(root);
+    std::cout << stats << std::endl;
+    auto bvh = root->build_linear_bvh();
+    std::cout << "Linear BVH: " << bvh->nodes().size() << " nodes, "
+              << bvh->primitives().size() << " primitives" << std::endl;
+    root->build_wide_bvh(FLAGS_bvh_width);
   }
 
   std::unique_ptr<Canvas> canvas;
   {
     Timer t("Rendering");
     auto world = World();
-    world.set_light(*light);
+    world.set_light(light.get());
     world.add(root);
+    world.commit();
 
-    auto ex = folly::CPUThreadPoolExecutor(20);
-    auto task = camera->multi_render(world);
-    canvas = std::make_unique<Canvas>(
-        folly::coro::blockingWait(std::move(task).scheduleOn(&ex)));
+    RenderOptions options;
+    options.tile_size = FLAGS_tile_size;
+    options.order = tile_order_from(FLAGS_tile_order);
+    options.threads = FLAGS_threads;
+    options.samples = FLAGS_samples;
+    options.tolerance = FLAGS_tolerance;
+    options.min_samples = FLAGS_min_samples;
+    options.sampler = make_sampler(FLAGS_sampler, FLAGS_samples, FLAGS_frame);
+    camera->set_packet_size(FLAGS_packet_size);
+    if (FLAGS_async_window > 0) {
+      auto threads = FLAGS_threads > 0 ? FLAGS_threads
+                                       : std::thread::hardware_concurrency();
+      auto ex = folly::CPUThreadPoolExecutor(threads);
+      auto task = camera->render_async(world, options, FLAGS_async_window);
+      canvas = std::make_unique<Canvas>(
+          folly::coro::blockingWait(std::move(task).scheduleOn(&ex)));
+    } else {
+      RenderStats stats;
+      canvas =
+          std::make_unique<Canvas>(camera->render(world, options, &stats));
+      std::cout << stats << std::endl;
+      if (FLAGS_tile_timings) {
+        for (const auto& t : stats.tiles) {
+          std::cout << "tile (" << t.tile.x0 << ", " << t.tile.y0 << "): "
+                    << t.millis << " ms on thread " << t.thread << std::endl;
+        }
+      }
+    }
   }
-  canvas->save("/tmp/render.ppm");
+  canvas->save(FLAGS_out);
 }
\ No newline at end of file
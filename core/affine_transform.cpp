@@ -0,0 +1,79 @@
+#include "affine_transform.h"
+
+AffineTransform::AffineTransform() : c_{} {
+  c_[0][0] = 1.0;
+  c_[1][1] = 1.0;
+  c_[2][2] = 1.0;
+}
+
+AffineTransform::AffineTransform(const Matrix& m) : c_{} {
+  for (size_t col = 0; col < 4; ++col) {
+    for (size_t row = 0; row < 3; ++row) {
+      c_[col][row] = m.get(row, col);
+    }
+  }
+}
+
+Matrix AffineTransform::matrix() const {
+  Matrix out(IDENTITY);
+  for (size_t col = 0; col < 4; ++col) {
+    for (size_t row = 0; row < 3; ++row) {
+      out.set(row, col, c_[col][row]);
+    }
+  }
+  return out;
+}
+
+AffineTransform AffineTransform::inverse() const {
+  const Vec3 a(c_[0][0], c_[0][1], c_[0][2]);
+  const Vec3 b(c_[1][0], c_[1][1], c_[1][2]);
+  const Vec3 c(c_[2][0], c_[2][1], c_[2][2]);
+
+  // rows of the inverse of the 3x3 part
+  const auto bc = cross(b, c);
+  const auto f = 1.0 / dot(a, bc);
+  const Vec3 rows[3] = {bc * f, cross(c, a) * f, cross(a, b) * f};
+
+  AffineTransform out;
+  for (size_t row = 0; row < 3; ++row) {
+    out.c_[0][row] = rows[row].x;
+    out.c_[1][row] = rows[row].y;
+    out.c_[2][row] = rows[row].z;
+  }
+  const Vec3 t(c_[3][0], c_[3][1], c_[3][2]);
+  auto back = out * t;
+  out.c_[3][0] = -back.x;
+  out.c_[3][1] = -back.y;
+  out.c_[3][2] = -back.z;
+  return out;
+}
+
+AffineTransform AffineTransform::linear_transpose() const {
+  AffineTransform out;
+  for (size_t col = 0; col < 3; ++col) {
+    for (size_t row = 0; row < 3; ++row) {
+      out.c_[col][row] = c_[row][col];
+    }
+  }
+  return out;
+}
+
+AffineTransform operator*(const AffineTransform& a, const AffineTransform& b) {
+  AffineTransform out;
+  for (size_t col = 0; col < 4; ++col) {
+    a.apply(b.c_[col][0], b.c_[col][1], b.c_[col][2], col == 3 ? 1.0 : 0.0,
+            out.c_[col]);
+  }
+  return out;
+}
+
+bool operator==(const AffineTransform& a, const AffineTransform& b) {
+  for (size_t col = 0; col < 4; ++col) {
+    for (size_t row = 0; row < 3; ++row) {
+      if (a.c_[col][row] != b.c_[col][row]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "matrix.h"
+#include "tuple.h"
+#include "vec3.h"
+
+// The top three rows of a 4x4 transform whose bottom row is 0 0 0 1, which
+// covers every translation, rotation, scaling and shearing (and products of
+// them) that scenes use. Storage is four padded columns, so applying the
+// transform is three multiplies and three adds of whole columns: one
+// register per column (AVX for double, SSE for float Real) when the target
+// has it, otherwise plain loops the compiler is free to vectorise.
+//
+// Products are evaluated in the same order as Matrix * Tuple, so with
+// double Real and without FMA contraction the results are bit-identical to
+// the 4x4 path.
+class AffineTransform {
+ public:
+  AffineTransform();  // identity
+
+  // Drops the bottom row of m, which must be 0 0 0 1.
+  explicit AffineTransform(const Matrix& m);
+
+  Matrix matrix() const;
+
+  // Closed form: the 3x3 part is inverted through cross products of its
+  // columns, and the translation is mapped back through that inverse.
+  // Like Matrix::inverse() a singular transform yields non-finite values.
+  AffineTransform inverse() const;
+
+  // The transpose of the 3x3 part with no translation. Taken of an
+  // inverse this is the normal matrix.
+  AffineTransform linear_transpose() const;
+
+  Real get(size_t row, size_t column) const { return c_[column][row]; }
+
+  Point3 operator*(const Point3& p) const {
+    Real out[3];
+    apply(p.x, p.y, p.z, 1.0, out);
+    return {out[0], out[1], out[2]};
+  }
+
+  Vec3 operator*(const Vec3& v) const {
+    Real out[3];
+    apply(v.x, v.y, v.z, 0.0, out);
+    return {out[0], out[1], out[2]};
+  }
+
+  // Only the 3x3 part; the caller picks the normal matrix.
+  Normal3 operator*(const Normal3& n) const {
+    Real out[3];
+    apply(n.x, n.y, n.z, 0.0, out);
+    return {out[0], out[1], out[2]};
+  }
+
+  Tuple operator*(const Tuple& t) const {
+    Real out[3];
+    apply(t.x, t.y, t.z, t.w, out);
+    return {out[0], out[1], out[2], t.w};
+  }
+
+  friend AffineTransform operator*(const AffineTransform& a,
+                                   const AffineTransform& b);
+  friend bool operator==(const AffineTransform& a, const AffineTransform& b);
+
+ private:
+  // out[0..2] = c0 * x + c1 * y + c2 * z + c3 * w
+  void apply(Real x, Real y, Real z, Real w, Real* out) const {
+#if defined(RAYTRACE_SINGLE_PRECISION) && defined(__SSE__)
+    __m128 r = _mm_add_ps(
+        _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(c_[0]), _mm_set1_ps(x)),
+                              _mm_mul_ps(_mm_load_ps(c_[1]), _mm_set1_ps(y))),
+                   _mm_mul_ps(_mm_load_ps(c_[2]), _mm_set1_ps(z))),
+        _mm_mul_ps(_mm_load_ps(c_[3]), _mm_set1_ps(w)));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, r);
+    out[0] = lanes[0];
+    out[1] = lanes[1];
+    out[2] = lanes[2];
+#elif !defined(RAYTRACE_SINGLE_PRECISION) && defined(__AVX__)
+    __m256d r = _mm256_add_pd(
+        _mm256_add_pd(
+            _mm256_add_pd(
+                _mm256_mul_pd(_mm256_load_pd(c_[0]), _mm256_set1_pd(x)),
+                _mm256_mul_pd(_mm256_load_pd(c_[1]), _mm256_set1_pd(y))),
+            _mm256_mul_pd(_mm256_load_pd(c_[2]), _mm256_set1_pd(z))),
+        _mm256_mul_pd(_mm256_load_pd(c_[3]), _mm256_set1_pd(w)));
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, r);
+    out[0] = lanes[0];
+    out[1] = lanes[1];
+    out[2] = lanes[2];
+#else
+    for (size_t i = 0; i < 3; ++i) {
+      out[i] = c_[0][i] * x + c_[1][i] * y + c_[2][i] * z + c_[3][i] * w;
+    }
+#endif
+  }
+
+  // c_[column][row]; row 3 is padding and always zero.
+  alignas(32) Real c_[4][4];
+};
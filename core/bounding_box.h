@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "affine_transform.h"
 #include "matrix.h"
 #include "ray.h"
 #include "tuple.h"
@@ -70,21 +71,27 @@ class BoundingBox {
   }
 
   BoundingBox transform(const Matrix& m) {
-    auto p1 = min_;
-    auto p2 = Tuple::point(min_.x, min_.y, max_.z);
-    auto p3 = Tuple::point(min_.x, max_.y, min_.z);
-    auto p4 = Tuple::point(min_.x, max_.y, max_.z);
-    auto p5 = Tuple::point(max_.x, min_.y, min_.z);
-    auto p6 = Tuple::point(max_.x, min_.y, max_.z);
-    auto p7 = Tuple::point(max_.x, max_.y, min_.z);
-    auto p8 = max_;
-
-    auto new_bbox = BoundingBox();
-
-    for(const auto& p : {p1, p2, p3, p4, p5, p6, p7, p8}) {
-      new_bbox.add(m * p);
+    return transform(AffineTransform(m));
+  }
+
+  // Arvo's method: each output bound is the translation plus, per input
+  // axis, whichever end of that axis the matrix entry pulls further. Same
+  // box as transforming all eight corners, for a fraction of the work.
+  BoundingBox transform(const AffineTransform& m) {
+    const double lo[3] = {min_.x, min_.y, min_.z};
+    const double hi[3] = {max_.x, max_.y, max_.z};
+    double out_lo[3], out_hi[3];
+    for (size_t row = 0; row < 3; ++row) {
+      out_lo[row] = out_hi[row] = m.get(row, 3);
+      for (size_t col = 0; col < 3; ++col) {
+        auto a = m.get(row, col) * lo[col];
+        auto b = m.get(row, col) * hi[col];
+        out_lo[row] += std::min(a, b);
+        out_hi[row] += std::max(a, b);
+      }
     }
-    return new_bbox;
+    return BoundingBox(Tuple::point(out_lo[0], out_lo[1], out_lo[2]),
+                       Tuple::point(out_hi[0], out_hi[1], out_hi[2]));
   }
 
   std::pair<double, double> check_axis(const double origin, const double direction, const double min, const double max) {
@@ -112,6 +119,28 @@ class BoundingBox {
     max_ = NEGATIVE_INF;
   }
 
+  // false for empty boxes and for shapes (like planes) that extend to infinity
+  bool bounded() const {
+    return min_.x <= max_.x && min_.y <= max_.y && min_.z <= max_.z &&
+           max_.x - min_.x < DBL_MAX && max_.y - min_.y < DBL_MAX &&
+           max_.z - min_.z < DBL_MAX;
+  }
+
+  Tuple centroid() const {
+    return Tuple::point((min_.x + max_.x) / 2.0, (min_.y + max_.y) / 2.0,
+                        (min_.z + max_.z) / 2.0);
+  }
+
+  double surface_area() const {
+    if (!bounded()) {
+      return 0.0;
+    }
+    auto dx = max_.x - min_.x;
+    auto dy = max_.y - min_.y;
+    auto dz = max_.z - min_.z;
+    return 2.0 * (dx * dy + dy * dz + dz * dx);
+  }
+
   std::pair<BoundingBox, BoundingBox> split() {
     auto dx = abs(min_.x - max_.x);
     auto dy = abs(min_.y - max_.y);
@@ -0,0 +1,312 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/task_group.h>
+
+namespace {
+double axis_of(const Tuple& t, int axis) {
+  return axis == 0 ? t.x : (axis == 1 ? t.y : t.z);
+}
+}  // namespace
+
+BVHStats BVHBuilder::build(Group* root) {
+  const auto start = std::chrono::steady_clock::now();
+  BVHStats stats;
+
+  auto children = root->release_children();
+  stats.primitives = children.size();
+
+  // parent_space_bounds_of() only writes the child's own cache, so the
+  // children can be measured concurrently
+  std::vector<PrimitiveRef> all(children.size());
+  auto measure = [&](size_t i) {
+    auto bounds = *children[i]->parent_space_bounds_of();
+    all[i] = {children[i], bounds, bounds.centroid()};
+  };
+  if (options_.parallel && children.size() >= options_.parallel_threshold) {
+    tbb::parallel_for(size_t(0), children.size(), measure);
+  } else {
+    for (size_t i = 0; i < children.size(); ++i) {
+      measure(i);
+    }
+  }
+
+  std::vector<PrimitiveRef> refs;
+  refs.reserve(all.size());
+  for (const auto& r : all) {
+    if (r.bounds.bounded()) {
+      refs.push_back(r);
+    } else {
+      root->add(r.shape);
+    }
+  }
+
+  auto tree = subdivide(refs.begin(), refs.end(), 0);
+  if (tree->leaf()) {
+    for (auto it = tree->begin; it != tree->end; ++it) {
+      root->add(it->shape);
+    }
+    stats.leaves = refs.empty() ? 0 : 1;
+  } else {
+    stats.interior_nodes = 1;
+    emit(root, *tree->left, 1, &stats);
+    emit(root, *tree->right, 1, &stats);
+  }
+
+  stats.sah_cost = sah_cost(root);
+  stats.built_sah_cost = stats.sah_cost;
+  stats.build_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  return stats;
+}
+
+BVHStats BVHBuilder::update(Group* root, const BVHStats& previous) {
+  const auto start = std::chrono::steady_clock::now();
+
+  root->refit();
+  BVHStats stats = previous;
+  stats.rebuilt = false;
+  stats.sah_cost = sah_cost(root);
+
+  if (stats.sah_cost > previous.built_sah_cost * options_.rebuild_threshold) {
+    // changing the children drops the flattened BVHs; put back any there were
+    const bool linear = root->linear_bvh() != nullptr;
+    const auto width =
+        root->wide_bvh() != nullptr ? root->wide_bvh()->width() : 0;
+    for (const auto& p : root->release_primitives()) {
+      root->add(p);
+    }
+    stats = build(root);
+    if (linear) {
+      root->build_linear_bvh();
+    }
+    if (width > 0) {
+      root->build_wide_bvh(width);
+    }
+  }
+
+  stats.build_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+  return stats;
+}
+
+std::unique_ptr<BVHBuilder::BuildNode> BVHBuilder::subdivide(
+    RefIterator begin, RefIterator end, size_t depth) const {
+  auto node = std::make_unique<BuildNode>();
+  node->begin = begin;
+  node->end = end;
+
+  auto count = static_cast<size_t>(end - begin);
+  if (count <= std::max<size_t>(options_.leaf_size, 1) ||
+      depth >= options_.max_depth) {
+    return node;
+  }
+
+  auto mid = partition(begin, end);
+
+  // the halves are disjoint ranges of the ref array, so they can be
+  // partitioned independently
+  if (options_.parallel && count >= options_.parallel_threshold) {
+    tbb::task_group tasks;
+    tasks.run([&] { node->left = subdivide(begin, mid, depth + 1); });
+    node->right = subdivide(mid, end, depth + 1);
+    tasks.wait();
+  } else {
+    node->left = subdivide(begin, mid, depth + 1);
+    node->right = subdivide(mid, end, depth + 1);
+  }
+  return node;
+}
+
+void BVHBuilder::emit(Group* parent, const BuildNode& node, size_t depth,
+                      BVHStats* stats) const {
+  stats->depth = std::max(stats->depth, depth);
+
+  if (node.leaf()) {
+    stats->leaves++;
+    if (node.end - node.begin == 1) {
+      parent->add(node.begin->shape);
+      return;
+    }
+    ShapeVector shapes;
+    shapes.reserve(node.end - node.begin);
+    for (auto it = node.begin; it != node.end; ++it) {
+      shapes.push_back(it->shape);
+    }
+    parent->make_subgroup(shapes);
+    return;
+  }
+
+  auto group = parent->make_subgroup({});
+  stats->interior_nodes++;
+  emit(group, *node.left, depth + 1, stats);
+  emit(group, *node.right, depth + 1, stats);
+}
+
+// Bins are laid out axis-major: bins[axis * n + i].
+void BVHBuilder::fill_bins(RefIterator begin, RefIterator end,
+                           const BoundingBox& centroids,
+                           std::vector<Bin>* bins) const {
+  const size_t n = bins->size() / 3;
+  double cmin[3], scale[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    cmin[axis] = axis_of(centroids.min(), axis);
+    auto extent = axis_of(centroids.max(), axis) - cmin[axis];
+    scale[axis] = extent > 0.0 ? n / extent : 0.0;
+  }
+
+  auto accumulate = [&](RefIterator b, RefIterator e, std::vector<Bin>& out) {
+    for (auto it = b; it != e; ++it) {
+      for (int axis = 0; axis < 3; ++axis) {
+        auto i = static_cast<size_t>((axis_of(it->centroid, axis) - cmin[axis]) *
+                                     scale[axis]);
+        auto& bin = out[axis * n + std::min(i, n - 1)];
+        bin.bounds.add(it->bounds);
+        bin.count++;
+      }
+    }
+  };
+
+  if (!options_.parallel ||
+      static_cast<size_t>(end - begin) < options_.parallel_threshold) {
+    accumulate(begin, end, *bins);
+    return;
+  }
+
+  *bins = tbb::parallel_reduce(
+      tbb::blocked_range<RefIterator>(begin, end), *bins,
+      [&](const tbb::blocked_range<RefIterator>& r, std::vector<Bin> local) {
+        accumulate(r.begin(), r.end(), local);
+        return local;
+      },
+      [](std::vector<Bin> a, const std::vector<Bin>& b) {
+        for (size_t i = 0; i < a.size(); ++i) {
+          a[i].bounds.add(b[i].bounds);
+          a[i].count += b[i].count;
+        }
+        return a;
+      });
+}
+
+BVHBuilder::RefIterator BVHBuilder::partition(RefIterator begin,
+                                              RefIterator end) const {
+  const auto count = static_cast<size_t>(end - begin);
+  const auto n = std::max<size_t>(options_.bins, 2);
+
+  BoundingBox centroids;
+  for (auto it = begin; it != end; ++it) {
+    centroids.add(it->centroid);
+  }
+
+  std::vector<Bin> bins(3 * n);
+  fill_bins(begin, end, centroids, &bins);
+
+  BoundingBox bounds;
+  for (size_t i = 0; i < n; ++i) {
+    bounds.add(bins[i].bounds);
+  }
+  const double area = bounds.surface_area();
+
+  int best_axis = -1;
+  size_t best_split = 0;
+  double best_cost = INFINITY;
+
+  for (int axis = 0; axis < 3; ++axis) {
+    if (axis_of(centroids.max(), axis) - axis_of(centroids.min(), axis) <=
+        0.0) {
+      continue;
+    }
+    const Bin* buckets = &bins[axis * n];
+
+    // sweep from the right so each split's right-hand cost is a lookup
+    std::vector<double> right_cost(n, 0.0);
+    BoundingBox right;
+    size_t right_count = 0;
+    for (size_t i = n - 1; i > 0; --i) {
+      right.add(buckets[i].bounds);
+      right_count += buckets[i].count;
+      right_cost[i] = right_count * right.surface_area();
+    }
+
+    BoundingBox left;
+    size_t left_count = 0;
+    for (size_t split = 1; split < n; ++split) {
+      left.add(buckets[split - 1].bounds);
+      left_count += buckets[split - 1].count;
+      if (left_count == 0 || left_count == count) {
+        continue;
+      }
+      double cost = options_.traversal_cost +
+                    options_.intersection_cost *
+                        (left_count * left.surface_area() + right_cost[split]) /
+                        area;
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = split;
+      }
+    }
+  }
+
+  RefIterator mid = begin + count / 2;
+  if (best_axis >= 0) {
+    const double cmin = axis_of(centroids.min(), best_axis);
+    const double extent = axis_of(centroids.max(), best_axis) - cmin;
+    mid = std::partition(begin, end, [&](const PrimitiveRef& r) {
+      auto b = static_cast<size_t>(n * (axis_of(r.centroid, best_axis) - cmin) /
+                                   extent);
+      return std::min(b, n - 1) < best_split;
+    });
+  }
+
+  // every centroid in one spot (or a degenerate split): fall back to a median
+  if (mid == begin || mid == end) {
+    mid = begin + count / 2;
+  }
+  return mid;
+}
+
+double BVHBuilder::sah_cost(Group* root) const {
+  BoundingBox bounds;
+  for (const auto& c : root->children()) {
+    auto b = c->parent_space_bounds_of();
+    if (b->bounded()) {
+      bounds.add(*b);
+    }
+  }
+  const double root_area = bounds.surface_area();
+  if (root_area <= 0.0) {
+    return 0.0;
+  }
+
+  double cost = options_.traversal_cost;
+  for (const auto& c : root->children()) {
+    cost += node_cost(c, root_area, root_area);
+  }
+  return cost;
+}
+
+// A child is tested whenever its parent's box is hit, so a primitive costs
+// one intersection weighted by the probability of reaching its parent.
+double BVHBuilder::node_cost(Shape* node, double parent_area,
+                             double root_area) const {
+  const double reach = parent_area / root_area;
+  auto group = dynamic_cast<Group*>(node);
+  if (group == nullptr) {
+    return options_.intersection_cost * reach;
+  }
+
+  const double area = group->parent_space_bounds_of()->surface_area();
+  double cost = options_.traversal_cost * reach;
+  for (const auto& c : group->children()) {
+    cost += node_cost(c, area, root_area);
+  }
+  return cost;
+}
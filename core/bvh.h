@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "../shapes/group.h"
+#include "bounding_box.h"
+
+struct BVHBuildOptions {
+  size_t leaf_size = 4;      // max primitives per leaf (unless max_depth hit)
+  size_t max_depth = 64;     // leaves are forced below this depth
+  size_t bins = 16;          // SAH buckets per axis
+  double traversal_cost = 1.0;
+  double intersection_cost = 1.0;
+  bool parallel = false;     // subdivide with TBB tasks
+  size_t parallel_threshold = 4096;  // smaller ranges are built serially
+  double rebuild_threshold = 1.5;    // update() rebuilds past this SAH ratio
+};
+
+struct BVHStats {
+  double build_seconds = 0.0;
+  double sah_cost = 0.0;
+  double built_sah_cost = 0.0;  // cost when the topology was last built
+  bool rebuilt = true;          // false when update() only refit the boxes
+  size_t primitives = 0;
+  size_t interior_nodes = 0;
+  size_t leaves = 0;
+  size_t depth = 0;
+
+  friend std::ostream& operator<<(std::ostream& os, const BVHStats& s) {
+    return os << "BVH(" << s.primitives << " primitives, " << s.interior_nodes
+              << " interior nodes, " << s.leaves << " leaves, depth "
+              << s.depth << ", SAH cost " << s.sah_cost << ", built in "
+              << s.build_seconds << " seconds)";
+  }
+};
+
+// Binned surface-area-heuristic builder. Replaces the children of a Group
+// with a binary tree of subgroups in which every primitive lives in exactly
+// one leaf. Unbounded children (planes) stay attached to the root.
+class BVHBuilder {
+ public:
+  explicit BVHBuilder(const BVHBuildOptions& options = {}) : options_(options) {}
+
+  BVHStats build(Group* root);
+
+  // For animated scenes: refits the existing hierarchy to the children's
+  // new transforms and only rebuilds it when the SAH cost has grown past
+  // rebuild_threshold times its cost at the last full build.
+  BVHStats update(Group* root, const BVHStats& previous);
+
+  // SAH cost of an existing hierarchy, relative to the root's surface area.
+  double sah_cost(Group* root) const;
+
+ private:
+  struct PrimitiveRef {
+    Shape* shape = nullptr;
+    BoundingBox bounds;
+    Tuple centroid = Tuple::point(0, 0, 0);
+  };
+
+  using RefIterator = std::vector<PrimitiveRef>::iterator;
+
+  // Intermediate tree produced by the (possibly parallel) subdivision pass;
+  // Groups are only created afterwards, on one thread.
+  struct BuildNode {
+    RefIterator begin;
+    RefIterator end;
+    std::unique_ptr<BuildNode> left;
+    std::unique_ptr<BuildNode> right;
+
+    bool leaf() const { return left == nullptr; }
+  };
+
+  struct Bin {
+    BoundingBox bounds;
+    size_t count = 0;
+  };
+
+  std::unique_ptr<BuildNode> subdivide(RefIterator begin, RefIterator end,
+                                       size_t depth) const;
+
+  void emit(Group* parent, const BuildNode& node, size_t depth,
+            BVHStats* stats) const;
+
+  RefIterator partition(RefIterator begin, RefIterator end) const;
+
+  void fill_bins(RefIterator begin, RefIterator end,
+                 const BoundingBox& centroids, std::vector<Bin>* bins) const;
+
+  double node_cost(Shape* node, double parent_area, double root_area) const;
+
+  BVHBuildOptions options_;
+};
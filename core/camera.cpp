@@ -4,6 +4,13 @@
 
 #include "camera.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "folly/experimental/coro/Collect.h"
+#include "folly/experimental/coro/CurrentExecutor.h"
+
 Matrix view_transform(const Tuple& from, const Tuple& to, const Tuple& up) {
   auto forward = (to - from).normalize();
   auto left = cross(forward, up.normalize());
@@ -21,3 +28,151 @@ Matrix view_transform(const Tuple& from, const Tuple& to, const Tuple& up) {
   // clang-format on
   return out * CreateTranslation(-from.x, -from.y, -from.z);
 }
+
+namespace {
+void check(const World& w, const RenderOptions& options) {
+  if (!w.committed()) {
+    throw std::runtime_error("render needs a committed world");
+  }
+  if (options.samples == 0) {
+    throw std::runtime_error("samples per pixel must be at least 1");
+  }
+  if (options.tolerance > 0 && options.min_samples < 2) {
+    throw std::runtime_error("adaptive sampling needs min_samples >= 2");
+  }
+}
+
+const Sampler& sampler_of(const RenderOptions& options) {
+  static const RandomSampler random;
+  return options.sampler != nullptr ? *options.sampler : random;
+}
+}  // namespace
+
+Canvas Camera::render(World& w, const RenderOptions& options,
+                      RenderStats* stats) {
+  check(w, options);
+
+  auto out = Canvas(hsize_, vsize_);
+  auto tiles = make_tiles(hsize_, vsize_, options.tile_size, options.order);
+  std::atomic<uint64_t> rays{0};
+  auto result = run_tiles(tiles, options.threads, [&](const Tile& tile) {
+    // one buffer per thread, reused for every tile it renders
+    static thread_local std::vector<Color> buffer;
+    buffer.assign(size_t(tile.width()) * tile.height(), Color(0, 0, 0));
+    rays.fetch_add(render_tile(w, tile, options, buffer.data()),
+                   std::memory_order_relaxed);
+    out.write_block(tile.x0, tile.y0, tile.width(), tile.height(),
+                    buffer.data());
+  });
+  result.rays = rays.load();
+  if (stats != nullptr) {
+    *stats = std::move(result);
+  }
+  return out;
+}
+
+folly::coro::Task<Canvas> Camera::render_async(World& w,
+                                               RenderOptions options,
+                                               size_t window) {
+  check(w, options);
+  if (window == 0) {
+    window = 2 * std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  auto out = Canvas(hsize_, vsize_);
+  const auto tiles =
+      make_tiles(hsize_, vsize_, options.tile_size, options.order);
+  co_await folly::coro::collectAllWindowed(
+      tile_tasks(w, tiles, options, &out), window);
+  co_return out;
+}
+
+folly::coro::Generator<folly::coro::Task<void>&&> Camera::tile_tasks(
+    World& w, const std::vector<Tile>& tiles, RenderOptions options,
+    Canvas* out) {
+  for (const auto& tile : tiles) {
+    co_yield render_tile_async(w, tile, options, out);
+  }
+}
+
+folly::coro::Task<void> Camera::render_tile_async(World& w, Tile tile,
+                                                  RenderOptions options,
+                                                  Canvas* out) {
+  // collectAllWindowed() starts each task inline; without this hop every
+  // tile would finish on the calling thread before the next one began
+  co_await folly::coro::co_reschedule_on_current_executor;
+  std::vector<Color> buffer(size_t(tile.width()) * tile.height(),
+                            Color(0, 0, 0));
+  render_tile(w, tile, options, buffer.data());
+  out->write_block(tile.x0, tile.y0, tile.width(), tile.height(),
+                   buffer.data());
+  co_return;
+}
+
+uint64_t Camera::render_tile(World& w, const Tile& tile,
+                             const RenderOptions& options, Color* out) {
+  // Area lights take their jitter from the pixel being sampled (see
+  // AreaLight::point_on()), which a packet of pixels can't provide.
+  const bool packets = options.samples == 1 &&
+                       dynamic_cast<PointLight*>(w.light()) != nullptr;
+  const Sampler& sampler = sampler_of(options);
+  uint64_t rays = 0;
+  for (auto y = tile.y0; y < tile.y1; ++y) {
+    auto row = out + size_t(y - tile.y0) * tile.width();
+    if (packets) {
+      trace_row(w, y, tile.x0, tile.x1, row);
+      rays += tile.width();
+      continue;
+    }
+    for (auto x = tile.x0; x < tile.x1; ++x) {
+      if (options.samples == 1) {
+        const SampleScope scope(&sampler, x, y, 0);
+        row[x - tile.x0] = w.color_at(ray_for_pixel(x, y));
+        ++rays;
+      } else {
+        row[x - tile.x0] = sample_pixel(w, x, y, options, &rays);
+      }
+    }
+  }
+  return rays;
+}
+
+Color Camera::sample_pixel(World& w, size_t x, size_t y,
+                           const RenderOptions& options, uint64_t* rays) {
+  ++*rays;
+  if (!w.closest_hit(ray_for_pixel(x, y))) {
+    return Color(0, 0, 0);
+  }
+
+  const Sampler& sampler = sampler_of(options);
+  const bool adaptive = options.tolerance > 0;
+  const auto first = adaptive ? std::min(options.min_samples, options.samples)
+                              : options.samples;
+  const auto tolerance2 = options.tolerance * options.tolerance;
+
+  // running mean and sum of squared deviations per channel (Welford)
+  Color mean(0, 0, 0);
+  Color m2(0, 0, 0);
+  size_t n = 0;
+  while (n < options.samples) {
+    const SampleScope scope(&sampler, x, y, n);
+    auto c = w.color_at(
+        ray_for_pixel(x + 0.5 - sampler.get(x, y, n, SampleDimension::PIXEL_X),
+                      y + 0.5 - sampler.get(x, y, n, SampleDimension::PIXEL_Y)));
+    ++n;
+    auto delta = c - mean;
+    mean += delta * (1.0 / n);
+    auto delta2 = c - mean;
+    m2 += Color(delta.x * delta2.x, delta.y * delta2.y, delta.z * delta2.z);
+
+    if (adaptive && n >= first) {
+      // the variance of the mean is the sample variance over n
+      auto limit = tolerance2 * (n - 1) * n;
+      if (m2.x <= limit && m2.y <= limit && m2.z <= limit) {
+        break;
+      }
+    }
+  }
+  *rays += n;
+  return mean;
+}
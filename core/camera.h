@@ -1,23 +1,36 @@
 #pragma once
 
+#include "affine_transform.h"
 #include "canvas.h"
 #include "color.h"
-#include "folly/executors/CPUThreadPoolExecutor.h"
-#include "folly/experimental/coro/FutureUtil.h"
+#include "folly/experimental/coro/Generator.h"
 #include "folly/experimental/coro/Task.h"
-//#include "folly/experimental/coro/Collect.h"
-#include <tbb/blocked_range2d.h>
-#include <tbb/parallel_for.h>
-#include "folly/Random.h"
-
-#include "../utils/timer.h"
 #include "matrix.h"
 #include "ray.h"
+#include "sampler.h"
+#include "tiles.h"
 #include "tuple.h"
 #include "world.h"
-#include "folly/Random.h"
 
-using Result = std::tuple<size_t, size_t, Color>;
+// How Camera::render() splits up and samples the image.
+struct RenderOptions {
+  size_t tile_size = 32;  // in pixels, along each side
+  TileOrder order = TileOrder::HILBERT;
+  size_t threads = 0;  // 0 for one per core
+  size_t samples = 1;  // rays per pixel; 1 traces the pixel centers
+
+  // Adaptive sampling, when tolerance > 0: a pixel takes min_samples rays,
+  // then more one at a time until the standard error of its mean color is
+  // within tolerance on every channel, or `samples` is reached.
+  double tolerance = 0.0;
+  size_t min_samples = 4;
+
+  // Where the jitter of each ray within its pixel, and the points it
+  // samples on area lights, come from; null for a RandomSampler. Every
+  // sampler is a function of the pixel and sample index alone, so the image
+  // is the same whatever the tiling and the number of threads.
+  std::shared_ptr<const Sampler> sampler;
+};
 
 class Camera {
  public:
@@ -28,8 +41,7 @@ class Camera {
         half_width_{0.0},
         half_height_{0.0},
         pixel_size_(ComputePixelSize(h, v, f)),
-        transform_(IDENTITY),
-        inverse_(IDENTITY) {}
+        transform_(IDENTITY) {}
 
   [[nodiscard]] double hsize() const { return hsize_; }
   [[nodiscard]] double vsize() const { return vsize_; }
@@ -38,251 +50,78 @@ class Camera {
   Matrix* transform() { return &transform_; }
   void set_transform(const Matrix& t) {
     transform_ = t;
-    inverse_ = t.inverse();
+    inverse_ = AffineTransform(t).inverse();
+    origin_ = inverse_ * Point3(0, 0, 0);
   }
 
   [[nodiscard]] double pixel_size() const { return pixel_size_; }
 
-  Ray ray_for_pixel(double px, double py) {
-    double xoff = (px + 0.5) * pixel_size_;
-    double yoff = (py + 0.5) * pixel_size_;
-
-    double world_x = half_width_ - xoff;
-    double world_y = half_height_ - yoff;
-
-    auto pixel = inverse_ * Tuple::point(world_x, world_y, -1);
-    auto origin = inverse_ * Tuple::point(0.0, 0.0, 0.0);
-    auto direction = (pixel - origin).normalize();
-
-    return Ray(origin, direction);
-  }
-
-  Canvas render(World w) {
-    auto out = Canvas(hsize_, vsize_);
-
-    size_t total = vsize_ * hsize_;
-    size_t current = 0;
-
-    for (int y = 0; y < vsize_ - 1; ++y) {
-      double pct = (double)current / total;
-      std::cout << "Now rendering pixel " << current << " of " << total << " ("
-                << pct << ")" << std::endl;
-      for (int x = 0; x < hsize_ - 1; ++x) {
-        auto r = ray_for_pixel(x, y);
-        auto c = w.color_at(r);
-        out.write_pixel(x, y, c);
-        current++;
-      }
-    }
-    return out;
-  }
-
-  Color process_pixel_tbb(World& w, size_t x, size_t y, const Tuple& origin,
-                          int samples) {
-    if (x == 0 && int(y) % 100 == 0) {
-      std::cout << "Executing for row " << y << std::endl;
-    }
-    Color c_out(0, 0, 0);
-
-    // Cheat and look for misses
-    auto r = ray_for_pixel(x, y);
-    auto hit = w.intersect(r);
-    if (hit.empty()) {
-      return c_out;
-    }
-
-    for (double i = 0; i < samples; ++i) {
-      double xoff = x + 0.5;
-      double yoff = y + 0.5;
-
-      double rx = folly::Random::randDouble01(); //drand48();
-      double ry = folly::Random::randDouble01(); //drand48();
-
-      xoff += (0.5 - rx);
-      yoff += (0.5 - ry);
-
-      xoff *= pixel_size();
-      yoff *= pixel_size();
-
-      double worldX = half_width_ - xoff;
-      double worldY = half_height_ - yoff;
-
-      auto pixel = inverse_ * Tuple::point(worldX, worldY, -1);
-      auto direction = (pixel - origin).normalize();
-
-      auto r = Ray(origin, direction);
-      c_out += w.color_at(r);
-    }
-    return c_out * (1.0 / samples);
-  }
-
-  Canvas multi_render_sampled_tbb(World w, size_t samples) {
-    auto origin = inverse_ * Tuple::point(0, 0, 0);
-    auto out = Canvas(hsize_, vsize_);
-
-    static tbb::auto_partitioner partitioner;
-    tbb::parallel_for(
-        tbb::blocked_range2d<size_t>(0, vsize() - 1,  0, hsize() - 1),
-        [&](const tbb::blocked_range2d<size_t>& r) {
-          for (size_t y = r.rows().begin(); y != r.rows().end(); ++y) {
-            for (size_t x = r.cols().begin(); x != r.cols().end(); ++x) {
-              out.write_pixel(x, y, process_pixel_tbb(w, x, y, origin, samples));
-            }
-          }
-        },
-        partitioner);
-    //    tbb::parallel_for(
-//        tbb::blocked_range<size_t>(0, vsize() - 1, 1),
-//        [&](tbb::blocked_range<size_t>& r) {
-//          for (size_t y = r.begin(); y != r.end(); ++y) {
-//            for (size_t x = 0; x < hsize() - 1; ++x) {
-//              auto c = process_pixel_tbb(w, x, y, origin, samples);
-//              out.write_pixel(x, y, c);
-//            }
-//          }
-//        },
-//        partitioner);
-    return out;
-  }
-
-  folly::coro::Task<Canvas> multi_render_sampled(World w, size_t samples) {
-    auto origin = inverse_ * Tuple::point(0, 0, 0);
-    auto out = Canvas(hsize_, vsize_);
-    std::vector<folly::SemiFuture<Pixel>> futs;
-    for (int y = 0; y < vsize_ - 1; ++y) {
-      for (int x = 0; x < hsize_ - 1; ++x) {
-        futs.push_back(process_pixel(w, x, y, origin, samples).semi());
-      }
-    }
-    std::vector<folly::Try<Pixel>> results =
-        co_await folly::collectAll(futs.begin(), futs.end());
-
-    for (const auto& p : results) {
-      out.write_pixel(p->x, p->y, p->c);
-    }
-    co_return out;
-  }
-
-  struct Pixel {
-    size_t x;
-    size_t y;
-    Color c;
-  };
-
-  folly::coro::Task<Pixel> process_pixel(World& w, size_t x, size_t y,
-                                         const Tuple& origin, int samples) {
-    if (x == 0 && int(y) % 100 == 0) {
-      std::cout << "Executing for row " << y << std::endl;
-    }
-    Color c_out(0, 0, 0);
-
-    // Cheat and look for misses
-    auto r = ray_for_pixel(x, y);
-    auto hit = w.intersect(r);
-    if (hit.empty()) {
-      co_return {x, y, c_out};
+  // Primary rays are traced in packets of this many neighbouring pixels
+  // (4, 8 or 16); 1 traces every ray on its own.
+  [[nodiscard]] size_t packet_size() const { return packet_size_; }
+  void set_packet_size(size_t n) {
+    if (n != 1 && n != 4 && n != 8 && n != 16) {
+      throw std::runtime_error("packet size must be 1, 4, 8 or 16");
     }
-
-    for (double i = 0; i < samples; ++i) {
-      double xoff = x + 0.5;
-      double yoff = y + 0.5;
-
-      double rx = folly::Random::randDouble01(); //drand48();
-      double ry = folly::Random::randDouble01(); //drand48();
-
-      xoff += (0.5 - rx);
-      yoff += (0.5 - ry);
-
-      xoff *= pixel_size();
-      yoff *= pixel_size();
-
-      double worldX = half_width_ - xoff;
-      double worldY = half_height_ - yoff;
-
-      auto pixel = inverse_ * Tuple::point(worldX, worldY, -1);
-      auto direction = (pixel - origin).normalize();
-
-      auto r = Ray(origin, direction);
-      c_out += w.color_at(r);
-    }
-    c_out = c_out * (1.0 / samples);
-    co_return {x, y, c_out};
+    packet_size_ = n;
   }
 
-  folly::coro::Task<std::vector<Color>> process_row(World& w, size_t y) {
-    if (y % 100 == 0) {
-      std::cout << "Executing for row " << y << std::endl;
-    }
-    std::vector<Color> out;
-    out.reserve(hsize_);
-
-    for (int x = 0; x < hsize_ - 1; ++x) {
-      out.push_back(w.color_at(ray_for_pixel(x, y)));
-    }
-    co_return out;
-  }
-
-  folly::coro::Task<std::vector<Result>> process_chunk(World& w, size_t x,
-                                                       size_t y,
-                                                       size_t block_size) {
-    std::vector<Result> out;
-    if ((x * y) % 100 == 0) {
-      std::cout << "processing chunk (" << x << ", " << y << ") - block size "
-                << block_size << std::endl;
-    }
-    for (size_t y2 = y; y2 < y + block_size; ++y2) {
-      for (size_t x2 = x; x2 < x + block_size; ++x2) {
-        out.push_back({x2, y2, w.color_at(ray_for_pixel(x2, y2))});
-      }
+  // Colors pixels [x0, x1) of row y into out.
+  void trace_row(World& w, size_t y, size_t x0, size_t x1, Color* out) {
+    switch (packet_size_) {
+      case 4:
+        return trace_row_packets<4>(w, y, x0, x1, out);
+      case 8:
+        return trace_row_packets<8>(w, y, x0, x1, out);
+      case 16:
+        return trace_row_packets<16>(w, y, x0, x1, out);
+      default:
+        for (size_t x = x0; x < x1; ++x) {
+          out[x - x0] = w.color_at(ray_for_pixel(x, y));
+        }
     }
-    co_return out;
   }
 
-  folly::coro::Task<Canvas> multi_render(World w) {
-    auto out = Canvas(hsize_, vsize_);
-    std::vector<folly::SemiFuture<std::vector<Color>>> futs;
-    for (int y = 0; y < vsize_ - 1; ++y) {
-      futs.push_back(process_row(w, y).semi());
-    }
+  Ray ray_for_pixel(double px, double py) {
+    double xoff = (px + 0.5) * pixel_size_;
+    double yoff = (py + 0.5) * pixel_size_;
 
-    std::vector<folly::Try<std::vector<Color>>> results =
-        co_await folly::collectAll(futs.begin(), futs.end());
+    double world_x = half_width_ - xoff;
+    double world_y = half_height_ - yoff;
 
-    for (int y = 0; y < vsize() - 1; ++y) {
-      for (int x = 0; x < hsize() - 1; ++x) {
-        out.write_pixel(x, y, results[y].value()[x]);
-      }
-    }
-    co_return out;
+    const Point3 pixel = inverse_ * Point3(world_x, world_y, -1);
+    return Ray(origin_, (pixel - origin_).normalize());
   }
 
-  folly::coro::Task<std::vector<Result>> multi_render2(World w,
-                                                       size_t block_size) {
-    std::vector<folly::SemiFuture<std::vector<Result>>> futs;
-
-    {
-      Timer t("creating futures");
-      size_t i = 0;
-      for (int x = 0; x < hsize_ - 1; x += block_size) {
-        for (int y = 0; y < vsize_ - 1; y += block_size) {
-          futs.push_back(process_chunk(w, x, y, block_size).semi());
-        }
-      }
-    }
-
-    auto result = co_await folly::collectAll(futs.begin(), futs.end());
-
-    std::vector<Result> out;
-    {
-      Timer t("collecting results");
-      for (const auto& rtry : result) {
-        for (const auto& r : rtry.value()) {
-          out.push_back(r);
-        }
-      }
-    }
-    co_return out;
-  }
+  // Renders the image tile by tile on a work-stealing thread pool (see
+  // run_tiles()): each tile is traced into a per-thread buffer, which is
+  // then copied into the canvas. Throws std::runtime_error unless the world
+  // is committed (see World::commit()), since tracing from many threads
+  // must not write to the scene. If `stats` is given it receives the
+  // per-tile timings and the number of camera rays traced.
+  Canvas render(World& w, const RenderOptions& options = {},
+                RenderStats* stats = nullptr);
+
+  // render() as a coroutine, for callers that already run on a folly
+  // executor: tiles are rendered on whatever executor the task is scheduled
+  // on, at most `window` at a time (0 for twice the cores). Tiles are made
+  // into tasks only as earlier ones finish, and each writes its pixels
+  // straight into the canvas, so beyond the canvas itself memory is a
+  // window's worth of tile buffers whatever the image size.
+  folly::coro::Task<Canvas> render_async(World& w, RenderOptions options = {},
+                                         size_t window = 0);
+
+  // Colors the pixels of `tile` into out, row after row. Returns the
+  // number of camera rays traced.
+  uint64_t render_tile(World& w, const Tile& tile,
+                       const RenderOptions& options, Color* out);
+
+  // The average of rays jittered across pixel (x, y), as many as
+  // options.samples asks for (see RenderOptions::tolerance); *rays is
+  // increased by the number traced. A pixel whose center ray hits nothing
+  // is taken to be black without sampling.
+  Color sample_pixel(World& w, size_t x, size_t y,
+                     const RenderOptions& options, uint64_t* rays);
 
   bool operator==(const Camera& rhs) const {
     return (hsize_ == rhs.hsize_ && vsize_ == rhs.vsize_ &&
@@ -294,6 +133,30 @@ class Camera {
   }
 
  private:
+  template <size_t N>
+  void trace_row_packets(World& w, size_t y, size_t x0, size_t x1,
+                         Color* out) {
+    // one buffer per thread, reused for every row it traces
+    static thread_local std::vector<Ray> rays;
+    rays.clear();
+    for (size_t x = x0; x < x1; ++x) {
+      rays.push_back(ray_for_pixel(x, y));
+    }
+    for (size_t x = x0; x < x1; x += N) {
+      auto n = std::min(N, x1 - x);
+      w.color_at<N>(rays.data() + (x - x0), n, out + (x - x0));
+    }
+  }
+
+  // One task per tile of `tiles`, created as the consumer asks for them.
+  folly::coro::Generator<folly::coro::Task<void>&&> tile_tasks(
+      World& w, const std::vector<Tile>& tiles, RenderOptions options,
+      Canvas* out);
+
+  folly::coro::Task<void> render_tile_async(World& w, Tile tile,
+                                            RenderOptions options,
+                                            Canvas* out);
+
   int hsize_;
   int vsize_;
   double field_of_view_;
@@ -301,7 +164,9 @@ class Camera {
   double half_height_;
   double pixel_size_;
   Matrix transform_;
-  Matrix inverse_;
+  AffineTransform inverse_;
+  Point3 origin_;  // eye position in world space
+  size_t packet_size_ = 8;
 
   double ComputePixelSize(double h, double v, double f) {
     double half_view = tan(f / 2.0);
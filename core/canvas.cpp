@@ -0,0 +1,80 @@
+#include "canvas.h"
+
+#include <cmath>
+#include <stdexcept>
+
+Canvas Canvas::from_ppm(std::istream &in) {
+  // header fields and samples are whitespace separated; '#' starts a
+  // comment that runs to the end of the line
+  auto next = [&in]() {
+    std::string token;
+    while (in >> token) {
+      if (token[0] != '#') {
+        return token;
+      }
+      std::getline(in, token);
+    }
+    throw std::runtime_error("unexpected end of PPM data");
+  };
+  auto number = [&next]() {
+    auto token = next();
+    size_t used = 0;
+    auto out = std::stoi(token, &used);
+    if (used != token.size() || out < 0) {
+      throw std::runtime_error("bad PPM value: " + token);
+    }
+    return out;
+  };
+
+  if (next() != "P3") {
+    throw std::runtime_error("only plain (P3) PPM files are supported");
+  }
+  auto width = number();
+  auto height = number();
+  double scale = number();
+  if (width == 0 || height == 0 || scale == 0) {
+    throw std::runtime_error("bad PPM header");
+  }
+
+  Canvas out(width, height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      auto r = number() / scale;
+      auto g = number() / scale;
+      auto b = number() / scale;
+      out.write_pixel(x, y, Color(r, g, b));
+    }
+  }
+  return out;
+}
+
+ImageDifference difference(const Canvas &a, const Canvas &b) {
+  if (a.width() != b.width() || a.height() != b.height()) {
+    throw std::runtime_error("canvases differ in size");
+  }
+
+  ImageDifference out;
+  double sum = 0.0;
+  for (int y = 0; y < a.height(); ++y) {
+    for (int x = 0; x < a.width(); ++x) {
+      auto p = a.pixel_at(x, y);
+      auto q = b.pixel_at(x, y);
+      const double d[3] = {std::abs(p.r() - q.r()), std::abs(p.g() - q.g()),
+                           std::abs(p.b() - q.b())};
+      bool differs = false;
+      for (auto c : d) {
+        out.max = std::max(out.max, c);
+        sum += c * c;
+        differs |= c > EPSILON;
+      }
+      out.pixels += differs;
+    }
+  }
+  out.rms = std::sqrt(sum / (3.0 * a.width() * a.height()));
+  return out;
+}
+
+std::ostream &operator<<(std::ostream &os, const ImageDifference &d) {
+  return os << "max " << d.max << ", rms " << d.rms << ", " << d.pixels
+            << " pixels differ";
+}
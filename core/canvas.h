@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -31,6 +32,10 @@ int clamp(const double x, const double min, const double max) {
 
 class Canvas {
  public:
+  // Reads a plain (P3) PPM such as to_ppm() writes, scaling channels back
+  // to [0, 1]. Throws std::runtime_error on anything else.
+  static Canvas from_ppm(std::istream &in);
+
   Canvas(int width, int height) : width_(width), height_(height) {
     pixels_ =
         std::make_unique<ColorVector>(width * height, Color(0, 0, 0));
@@ -43,6 +48,15 @@ class Canvas {
     (*pixels_)[index_of(x, y)] = c;
   }
 
+  // Copies a width x height block of pixels, stored row after row, to
+  // (x, y). Blocks that don't overlap may be written concurrently.
+  void write_block(int x, int y, int width, int height, const Color *block) {
+    for (int row = 0; row < height; ++row) {
+      std::copy_n(block + row * width, width,
+                  pixels_->begin() + index_of(x, y + row));
+    }
+  }
+
   [[nodiscard]] int width() const { return width_; };
   [[nodiscard]] int height() const { return height_; };
 
@@ -94,3 +108,15 @@ class Canvas {
   int width_;
   int height_;
 };
+
+// How far apart two renders of the same scene are, per color channel.
+struct ImageDifference {
+  double max = 0.0;   // largest channel difference
+  double rms = 0.0;   // root mean square over every channel
+  size_t pixels = 0;  // pixels with some channel off by more than EPSILON
+};
+
+// Throws std::runtime_error if the canvases differ in size.
+ImageDifference difference(const Canvas &a, const Canvas &b);
+
+std::ostream &operator<<(std::ostream &os, const ImageDifference &d);
@@ -3,6 +3,8 @@
 //
 
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <ostream>
 #include <boost/flyweight.hpp>
 #include <folly/small_vector.h>
@@ -20,10 +22,28 @@ class Intersection {
  public:
   Intersection(double t, Shape* o) : t_(t), shape_(o) {}
   Intersection(double t, Shape* o, double u, double v) : t_(t), shape_(o), u{u}, v{v} {}
+  Intersection(double t, Shape* o, double u, double v, uint32_t index)
+      : u{u}, v{v}, t_(t), shape_(o), index_(index) {}
   double t() const { return t_; };
 
   Shape* object() const { return shape_; }
 
+  // Set when the hit came through an Instance; the object then lives in the
+  // instance's shared prototype rather than in the world.
+  Shape* instance() const { return instance_; }
+  void set_instance(Shape* i) { instance_ = i; }
+
+  // Which primitive of the object was hit, for shapes made of many (e.g.
+  // the triangle number within a TriangleMesh).
+  uint32_t index() const { return index_; }
+
+  // Whether both hits are on the same surface: the same primitive of the
+  // same object, reached through the same instance.
+  bool same_surface(const Intersection& other) const {
+    return shape_ == other.shape_ && instance_ == other.instance_ &&
+           index_ == other.index_;
+  }
+
   friend std::ostream &operator<<(std::ostream &os, const Intersection &rhs) {
     return os << "Intersection(" << rhs.t() << ")";
   }
@@ -33,10 +53,12 @@ class Intersection {
  private:
   double t_;
   Shape* shape_;
+  Shape* instance_ = nullptr;
+  uint32_t index_ = 0;
 };
 
 inline bool operator==(const Intersection &a, const Intersection &b) {
-  return a.t() == b.t() && a.object() == b.object();
+  return a.t() == b.t() && a.same_surface(b);
 }
 
 //namespace folly {
@@ -44,7 +66,43 @@ inline bool operator==(const Intersection &a, const Intersection &b) {
 //  struct IsRelocatable<Intersection> : boost::true_type {};
 //}
 
-using IntersectionVector = std::vector<Intersection, tbb::scalable_allocator<Intersection>>;
+// Number of heap allocations made for IntersectionVectors so far. The
+// render loop reuses caller-provided lists, so this should stay flat once
+// they have grown to size.
+inline std::atomic<uint64_t>& intersection_allocations() {
+  static std::atomic<uint64_t> count{0};
+  return count;
+}
+
+template <typename T>
+class CountingAllocator : public tbb::scalable_allocator<T> {
+ public:
+  template <typename U>
+  struct rebind {
+    using other = CountingAllocator<U>;
+  };
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    intersection_allocations().fetch_add(1, std::memory_order_relaxed);
+    return tbb::scalable_allocator<T>::allocate(n);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&) {
+  return false;
+}
+
+using IntersectionVector = std::vector<Intersection, CountingAllocator<Intersection>>;
 //using IntersectionVector = std::vector<Intersection>;
 //using IntersectionVector = folly::fbvector<Intersection>;
 //using IntersectionVector = std::vector<Intersection, folly::SysArenaAllocator<Intersection>>;
\ No newline at end of file
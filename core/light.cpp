@@ -1,4 +1,6 @@
 #include "light.h"
+
+#include "sampler.h"
 #include "world.h"
 
 double PointLight::intensity_at(const Tuple& point, const World* world) const {
@@ -18,3 +20,18 @@ double AreaLight::intensity_at(const Tuple& point, const World* world) const {
   }
   return total / sampleCount_;
 }
+
+Tuple AreaLight::point_on(double u, double v) const {
+  const auto& sample = current_sample();
+  if (sample.sampler == nullptr) {
+    return corner_ + uvec_ * (u + 0.5) + vvec_ * (v + 0.5);
+  }
+  // consecutive indices per camera sample, so the light sees the sampler's
+  // sequence in order
+  const auto index = sample.index * sampleCount_ + size_t(v) * usteps_ +
+                     size_t(u);
+  const auto& s = *sample.sampler;
+  return corner_ +
+         uvec_ * (u + s.get(sample.x, sample.y, index, SampleDimension::LIGHT_U)) +
+         vvec_ * (v + s.get(sample.x, sample.y, index, SampleDimension::LIGHT_V));
+}
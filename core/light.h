@@ -3,7 +3,6 @@
 #include "color.h"
 #include "tuple.h"
 #include <vector>
-#include "folly/Random.h"
 
 class World;
 
@@ -81,9 +80,8 @@ class AreaLight : public Light {
   }
   double intensity_at(const Tuple& point, const World* world) const override;
 
-  Tuple point_on(double u, double v) const {
-    return corner_ +
-           uvec_ * (u + folly::Random::randDouble01()) +
-           vvec_ * (v + folly::Random::randDouble01());
-  }
+  // A point in cell (u, v) of the light. Inside a SampleScope the jitter
+  // within the cell comes from the scope's sampler, so a camera sample sees
+  // the same points every time it asks; otherwise it is the cell's center.
+  Tuple point_on(double u, double v) const;
 };
\ No newline at end of file
@@ -0,0 +1,363 @@
+#include "linear_bvh.h"
+
+#include <algorithm>
+
+#include "../shapes/group.h"
+#include "../shapes/primitive.h"
+
+namespace {
+void set_bounds(LinearBVHNode* node, const BoundingBox& bounds) {
+  auto min = bounds.min();
+  auto max = bounds.max();
+  node->min[0] = float_round_down(min.x);
+  node->min[1] = float_round_down(min.y);
+  node->min[2] = float_round_down(min.z);
+  node->max[0] = float_round_up(max.x);
+  node->max[1] = float_round_up(max.y);
+  node->max[2] = float_round_up(max.z);
+}
+
+constexpr size_t BINS = 16;
+constexpr size_t MAX_DEPTH = 64;
+
+double axis_of(const Tuple& t, int axis) {
+  return axis == 0 ? t.x : (axis == 1 ? t.y : t.z);
+}
+
+// Same binned SAH as BVHBuilder::partition(), emitting LinearBVH nodes in
+// depth-first order (first child right after its parent).
+void subdivide(std::vector<LinearBVH::BuildRef>* refs, size_t begin,
+               size_t end, size_t depth, size_t leaf_size,
+               LinearBVHNodeVector* nodes) {
+  BoundingBox bounds, centroids;
+  for (size_t i = begin; i < end; ++i) {
+    bounds.add((*refs)[i].bounds);
+    centroids.add((*refs)[i].centroid);
+  }
+
+  const auto index = static_cast<uint32_t>(nodes->size());
+  {
+    LinearBVHNode node{};
+    set_bounds(&node, bounds);
+    nodes->push_back(node);
+  }
+
+  const size_t count = end - begin;
+  if (count <= leaf_size || (depth >= MAX_DEPTH && count <= UINT16_MAX)) {
+    (*nodes)[index].offset = begin;
+    (*nodes)[index].count = count;
+    return;
+  }
+
+  std::array<BoundingBox, 3 * BINS> bins;
+  std::array<size_t, 3 * BINS> counts{};
+  double cmin[3], scale[3];
+  for (int a = 0; a < 3; ++a) {
+    cmin[a] = axis_of(centroids.min(), a);
+    auto extent = axis_of(centroids.max(), a) - cmin[a];
+    scale[a] = extent > 0.0 ? BINS / extent : 0.0;
+  }
+  auto bin_of = [&](const LinearBVH::BuildRef& r, int a) {
+    auto i = static_cast<size_t>((axis_of(r.centroid, a) - cmin[a]) * scale[a]);
+    return std::min(i, BINS - 1);
+  };
+  for (size_t i = begin; i < end; ++i) {
+    for (int a = 0; a < 3; ++a) {
+      auto b = a * BINS + bin_of((*refs)[i], a);
+      bins[b].add((*refs)[i].bounds);
+      counts[b]++;
+    }
+  }
+
+  int best_axis = -1;
+  size_t best_split = 0;
+  double best_cost = INFINITY;
+  for (int a = 0; a < 3; ++a) {
+    if (scale[a] == 0.0) {
+      continue;
+    }
+    std::array<double, BINS> right_cost{};
+    BoundingBox right;
+    size_t right_count = 0;
+    for (size_t i = BINS - 1; i > 0; --i) {
+      right.add(bins[a * BINS + i]);
+      right_count += counts[a * BINS + i];
+      right_cost[i] = right_count * right.surface_area();
+    }
+    BoundingBox left;
+    size_t left_count = 0;
+    for (size_t split = 1; split < BINS; ++split) {
+      left.add(bins[a * BINS + split - 1]);
+      left_count += counts[a * BINS + split - 1];
+      if (left_count == 0 || left_count == count) {
+        continue;
+      }
+      double cost = left_count * left.surface_area() + right_cost[split];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = a;
+        best_split = split;
+      }
+    }
+  }
+
+  auto first = refs->begin() + begin;
+  auto last = refs->begin() + end;
+  auto mid = first + count / 2;
+  if (best_axis >= 0) {
+    mid = std::partition(first, last, [&](const LinearBVH::BuildRef& r) {
+      return bin_of(r, best_axis) < best_split;
+    });
+  }
+  if (best_axis < 0 || mid == first || mid == last) {
+    // every centroid in one spot: any even split will do
+    best_axis = 0;
+    mid = first + count / 2;
+  }
+
+  // the first child holds the lower centroids, which is the near side for
+  // rays travelling along +axis
+  (*nodes)[index].axis = best_axis;
+  auto split = static_cast<size_t>(mid - refs->begin());
+  subdivide(refs, begin, split, depth + 1, leaf_size, nodes);
+  auto second = static_cast<uint32_t>(nodes->size());
+  subdivide(refs, split, end, depth + 1, leaf_size, nodes);
+  (*nodes)[index].offset = second;
+}
+
+Group* traversable(Shape* s) {
+  auto g = dynamic_cast<Group*>(s);
+  if (g != nullptr && g->transform() == Matrix(IDENTITY)) {
+    return g;
+  }
+  return nullptr;
+}
+}  // namespace
+
+LinearBVHRay::LinearBVHRay(const Ray& r) {
+  auto o = r.origin();
+  auto d = r.direction();
+  const double os[3] = {o.x, o.y, o.z};
+  for (int a = 0; a < 3; ++a) {
+    origin_down[a] = float_round_down(os[a]);
+    origin_up[a] = float_round_up(os[a]);
+  }
+  inv_direction[0] = 1.0f / static_cast<float>(d.x);
+  inv_direction[1] = 1.0f / static_cast<float>(d.y);
+  inv_direction[2] = 1.0f / static_cast<float>(d.z);
+  for (int i = 0; i < 3; ++i) {
+    negative[i] = std::signbit(inv_direction[i]);
+  }
+}
+
+LinearBVH::LinearBVH(Group* root) {
+  auto items = items_of(root);
+  if (!items.empty()) {
+    flatten(std::move(items));
+  }
+}
+
+// Empty subgroups are dropped here so that every leaf has at least one
+// primitive (a zero count marks an interior node).
+std::vector<LinearBVH::Item> LinearBVH::items_of(Group* g) {
+  std::vector<Item> out;
+  for (const auto& c : g->children()) {
+    if (c->size(/* recurse */ true) == 0) {
+      continue;
+    }
+    out.push_back({c, traversable(c)});
+  }
+  return out;
+}
+
+uint32_t LinearBVH::flatten(std::vector<Item> items) {
+  // a lone subgroup adds nothing but a box test; descend straight into it
+  while (items.size() == 1 && items[0].group != nullptr) {
+    items = items_of(items[0].group);
+  }
+
+  std::vector<Item> prims;
+  std::vector<Item> groups;
+  BoundingBox bounds;
+  for (const auto& i : items) {
+    (i.group == nullptr ? prims : groups).push_back(i);
+    bounds.add(*i.shape->parent_space_bounds_of());
+  }
+
+  if (groups.empty()) {
+    auto begin = primitives_.size();
+    std::vector<std::pair<PrimitiveKind, Shape*>> leaf;
+    for (const auto& p : prims) {
+      leaf.emplace_back(primitive_kind(p.shape), p.shape);
+    }
+    std::stable_sort(
+        leaf.begin(), leaf.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (const auto& [kind, shape] : leaf) {
+      primitives_.push_back(shape);
+      kinds_.push_back(kind);
+    }
+    return emit_leaf(begin, primitives_.size());
+  }
+
+  std::vector<Item> left, right;
+  if (!prims.empty()) {
+    left = std::move(prims);
+    right = std::move(groups);
+  } else {
+    auto mid = groups.begin() + groups.size() / 2;
+    left.assign(groups.begin(), mid);
+    right.assign(mid, groups.end());
+  }
+
+  // order the children along the axis that separates them best, so the
+  // traversal can visit the near one first
+  BoundingBox left_bounds, right_bounds;
+  for (const auto& i : left) {
+    left_bounds.add(*i.shape->parent_space_bounds_of());
+  }
+  for (const auto& i : right) {
+    right_bounds.add(*i.shape->parent_space_bounds_of());
+  }
+  auto lc = left_bounds.centroid();
+  auto rc = right_bounds.centroid();
+  double delta[3] = {rc.x - lc.x, rc.y - lc.y, rc.z - lc.z};
+  uint8_t axis = 0;
+  for (uint8_t a = 1; a < 3; ++a) {
+    if (std::abs(delta[a]) > std::abs(delta[axis])) {
+      axis = a;
+    }
+  }
+  if (delta[axis] < 0) {
+    std::swap(left, right);
+  }
+
+  auto index = emit_node(bounds);
+  nodes_[index].axis = axis;
+  flatten(std::move(left));
+  auto second = flatten(std::move(right));
+  nodes_[index].offset = second;
+  return index;
+}
+
+uint32_t LinearBVH::emit_leaf(size_t begin, size_t end) {
+  BoundingBox bounds;
+  for (size_t i = begin; i < end; ++i) {
+    bounds.add(*primitives_[i]->parent_space_bounds_of());
+  }
+
+  if (end - begin > UINT16_MAX) {
+    auto index = emit_node(bounds);
+    auto mid = begin + (end - begin) / 2;
+    emit_leaf(begin, mid);
+    nodes_[index].offset = emit_leaf(mid, end);
+    return index;
+  }
+
+  auto index = emit_node(bounds);
+  nodes_[index].offset = begin;
+  nodes_[index].count = end - begin;
+  return index;
+}
+
+uint32_t LinearBVH::emit_node(const BoundingBox& bounds) {
+  LinearBVHNode node{};
+  set_bounds(&node, bounds);
+
+  auto min = bounds.min();
+  auto max = bounds.max();
+  auto dx = max.x - min.x;
+  auto dy = max.y - min.y;
+  auto dz = max.z - min.z;
+  node.axis = (dx >= dy && dx >= dz) ? 0 : (dy >= dz ? 1 : 2);
+
+  nodes_.push_back(node);
+  return nodes_.size() - 1;
+}
+
+void LinearBVH::refit() {
+  // children always come after their parent, so a reverse sweep sees both
+  // children of a node before the node itself
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    auto& node = nodes_[i];
+    if (node.leaf()) {
+      BoundingBox bounds;
+      for (uint32_t p = 0; p < node.count; ++p) {
+        bounds.add(*primitives_[node.offset + p]->parent_space_bounds_of());
+      }
+      set_bounds(&node, bounds);
+      continue;
+    }
+    const auto& a = nodes_[i + 1];
+    const auto& b = nodes_[node.offset];
+    for (int axis = 0; axis < 3; ++axis) {
+      node.min[axis] = std::min(a.min[axis], b.min[axis]);
+      node.max[axis] = std::max(a.max[axis], b.max[axis]);
+    }
+  }
+}
+
+bool LinearBVH::occluded(const Ray& r, double tmin, double tmax) const {
+  bool found = false;
+  traverse(r, float_round_down(tmin), float_round_up(tmax),
+           [&](uint32_t first, uint32_t count, float* /* tmax */) {
+             found = for_each_primitive(
+                 &primitives_[first], &kinds_[first], count, [&](auto* p) {
+                   return primitive_occluded(p, r, tmin, tmax);
+                 });
+             return found;
+           });
+  return found;
+}
+
+std::optional<Intersection> LinearBVH::closest_hit(const Ray& r, double tmin,
+                                                   double tmax) const {
+  std::optional<Intersection> out;
+  traverse(r, float_round_down(tmin), float_round_up(tmax),
+           [&](uint32_t first, uint32_t count, float* box_tmax) {
+             for_each_primitive(
+                 &primitives_[first], &kinds_[first], count, [&](auto* p) {
+                   auto hit = primitive_closest_hit(p, r, tmin, tmax);
+                   if (hit) {
+                     out = hit;
+                     tmax = hit->t();
+                     *box_tmax = float_round_up(tmax);
+                   }
+                   return false;
+                 });
+             return false;
+           });
+  return out;
+}
+
+void LinearBVH::intersect(const Ray& r, IntersectionVector* out) const {
+  traverse(r, -INFINITY, INFINITY,
+           [&](uint32_t first, uint32_t count, float* /* tmax */) {
+             for_each_primitive(&primitives_[first], &kinds_[first], count,
+                                [&](auto* p) {
+                                  primitive_intersect_into(p, r, out);
+                                  return false;
+                                });
+             return false;
+           });
+}
+
+IntersectionVector LinearBVH::intersect(const Ray& r) const {
+  IntersectionVector out;
+  intersect(r, &out);
+  std::sort(out.begin(), out.end(),
+            [](const auto& a, const auto& b) { return a.t() < b.t(); });
+  return out;
+}
+
+LinearBVHNodeVector LinearBVH::build_nodes(std::vector<BuildRef>* refs,
+                                           size_t leaf_size) {
+  LinearBVHNodeVector nodes;
+  if (refs->empty()) {
+    return nodes;
+  }
+  nodes.reserve(2 * refs->size() / std::max<size_t>(leaf_size, 1) + 1);
+  subdivide(refs, 0, refs->size(), 0,
+            std::clamp<size_t>(leaf_size, 1, UINT16_MAX), &nodes);
+  return nodes;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <folly/small_vector.h>
+#include <tbb/cache_aligned_allocator.h>
+
+#include "bounding_box.h"
+#include "intersection.h"
+#include "ray.h"
+
+class Group;
+class Shape;
+template <size_t N>
+struct RayPacket;
+enum class PrimitiveKind : uint8_t;  // shapes/primitive.h
+
+// Entries kept inline by the traversal stacks. Nothing limits how deep a
+// tree gets (--bvh_max_depth, hand-nested groups), so deeper traversals
+// carry on in heap memory instead of overflowing.
+constexpr size_t BVH_STACK_SIZE = 128;
+
+// 32 bytes, so two nodes share a cache line. Interior nodes store their
+// first child immediately after themselves (depth-first order) and the
+// index of the second child in `offset`; leaves store a range of
+// primitive indices.
+struct alignas(32) LinearBVHNode {
+  float min[3];
+  float max[3];
+  uint32_t offset;
+  uint16_t count;  // 0 for interior nodes
+  uint8_t axis;
+  uint8_t pad;
+
+  bool leaf() const { return count > 0; }
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must be 32 bytes");
+
+using LinearBVHNodeVector =
+    std::vector<LinearBVHNode, tbb::cache_aligned_allocator<LinearBVHNode>>;
+
+// Node bounds are rounded outwards so the float box always contains the
+// double-precision one.
+inline float float_round_down(double d) {
+  if (d < -FLT_MAX) {
+    return -INFINITY;
+  }
+  auto f = static_cast<float>(d);
+  return f > d ? std::nextafter(f, -INFINITY) : f;
+}
+
+inline float float_round_up(double d) {
+  if (d > FLT_MAX) {
+    return INFINITY;
+  }
+  auto f = static_cast<float>(d);
+  return f < d ? std::nextafter(f, INFINITY) : f;
+}
+
+// Ray pre-processed for repeated slab tests against float node bounds.
+// The origin is kept rounded both ways: measuring min planes from
+// `origin_up` and max planes from `origin_down` grows every slab by the
+// rounding, where a single rounded origin would shift it and drop hits
+// along the box faces of scenes far from the origin.
+struct LinearBVHRay {
+  explicit LinearBVHRay(const Ray& r);
+
+  float origin_down[3];
+  float origin_up[3];
+  float inv_direction[3];
+  bool negative[3];
+};
+
+// A compact, flattened copy of a Group hierarchy. Subgroups with an identity
+// transform are folded into the node array; everything else (including
+// transformed subgroups) becomes a primitive, intersected in the root
+// group's object space.
+class LinearBVH {
+ public:
+  explicit LinearBVH(Group* root);
+
+  IntersectionVector intersect(const Ray& r) const;
+
+  // Appends the intersections to `out`, unsorted.
+  void intersect(const Ray& r, IntersectionVector* out) const;
+
+  // Any-hit query: true as soon as some primitive is hit in [tmin, tmax).
+  bool occluded(const Ray& r, double tmin, double tmax) const;
+
+  // Closest-hit query: visits leaves near to far and culls every box that
+  // starts beyond the nearest hit found so far.
+  std::optional<Intersection> closest_hit(const Ray& r, double tmin,
+                                          double tmax) const;
+
+  // Recomputes node bounds from the primitives' current bounds, keeping the
+  // node layout. Cheaper than a rebuild when only transforms have changed.
+  void refit();
+
+  const LinearBVHNodeVector& nodes() const { return nodes_; }
+  const std::vector<Shape*>& primitives() const { return primitives_; }
+
+  // The concrete type of each primitive. Within a leaf, primitives of the
+  // same kind are adjacent, for for_each_primitive().
+  const std::vector<PrimitiveKind>& kinds() const { return kinds_; }
+
+  static bool intersects(const LinearBVHNode& node, const LinearBVHRay& r,
+                         float tmin, float tmax) {
+    for (int a = 0; a < 3; ++a) {
+      float t0 = (node.min[a] - r.origin_up[a]) * r.inv_direction[a];
+      float t1 = (node.max[a] - r.origin_down[a]) * r.inv_direction[a];
+      if (t0 > t1) {
+        std::swap(t0, t1);
+      }
+      // written so that a NaN (0 * inf) leaves the interval untouched
+      tmin = t0 > tmin ? t0 : tmin;
+      tmax = t1 < tmax ? t1 : tmax;
+      if (tmin > tmax) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Visits every leaf whose box the ray enters within [tmin, tmax], near
+  // child first. `leaf(first, count, &tmax)` may shrink tmax to cull the
+  // rest of the tree, and returns true to stop the traversal early.
+  template <typename LeafFn>
+  void traverse(const Ray& r, float tmin, float tmax, LeafFn&& leaf) const {
+    traverse(nodes_, r, tmin, tmax, std::forward<LeafFn>(leaf));
+  }
+
+  // As above, over any node array laid out like nodes() (TriangleMesh keeps
+  // one whose leaves index its triangles, see build_nodes()).
+  template <typename LeafFn>
+  static void traverse(const LinearBVHNodeVector& nodes, const Ray& r,
+                       float tmin, float tmax, LeafFn&& leaf);
+
+  // A primitive for build_nodes(); `index` is however the caller finds it.
+  struct BuildRef {
+    uint32_t index;
+    BoundingBox bounds;
+    Tuple centroid = Tuple::point(0, 0, 0);
+  };
+
+  // Builds a node array over refs (binned SAH, at most leaf_size per leaf),
+  // reordering refs so that every leaf is a contiguous range of them. For
+  // shapes that keep a BVH over their own primitives (TriangleMesh,
+  // SphereSet); walk it with the static traverse() above.
+  static LinearBVHNodeVector build_nodes(std::vector<BuildRef>* refs,
+                                         size_t leaf_size);
+
+  // Packet version, defined in ray_packet.h. `leaf(first, count, mask)` is
+  // called with the lanes that reached the leaf; it may clear lanes from
+  // packet->active or shrink their tmax. Stops once no lane is active.
+  template <size_t N, typename LeafFn>
+  void traverse(RayPacket<N>* packet, LeafFn&& leaf) const;
+
+ private:
+  struct Item {
+    Shape* shape;
+    Group* group;  // non-null when the item is a traversable subgroup
+  };
+
+  static std::vector<Item> items_of(Group* g);
+
+  uint32_t flatten(std::vector<Item> items);
+  uint32_t emit_leaf(size_t begin, size_t end);
+  uint32_t emit_node(const BoundingBox& bounds);
+
+  LinearBVHNodeVector nodes_;
+  std::vector<Shape*> primitives_;
+  std::vector<PrimitiveKind> kinds_;
+};
+
+template <typename LeafFn>
+void LinearBVH::traverse(const LinearBVHNodeVector& nodes, const Ray& r,
+                         float tmin, float tmax, LeafFn&& leaf) {
+  if (nodes.empty()) {
+    return;
+  }
+
+  const LinearBVHRay lr(r);
+  // deeper trees than this spill to the heap
+  folly::small_vector<uint32_t, BVH_STACK_SIZE> stack;
+  uint32_t current = 0;
+
+  while (true) {
+    const auto& node = nodes[current];
+    if (intersects(node, lr, tmin, tmax)) {
+      if (node.leaf()) {
+        if (leaf(node.offset, node.count, &tmax)) {
+          return;
+        }
+      } else {
+        // visit the near child first, defer the far one
+        if (lr.negative[node.axis]) {
+          stack.push_back(current + 1);
+          current = node.offset;
+        } else {
+          stack.push_back(node.offset);
+          current = current + 1;
+        }
+        continue;
+      }
+    }
+    if (stack.empty()) {
+      break;
+    }
+    current = stack.back();
+    stack.pop_back();
+  }
+}
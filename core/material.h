@@ -3,6 +3,7 @@
 #include "color.h"
 #include "light.h"
 #include "pattern.h"
+#include "vec3.h"
 
 class Material {
  public:
@@ -46,31 +47,26 @@ class Material {
     Tuple ambient = effective * this->ambient();
     auto samples = light->samples();
 
-    Color sum(0, 0, 0);
-    for (const auto& sample : samples) {
-      Color specular(0, 0, 0);
-      Color diffuse(0, 0, 0);
-
-      auto light_v = (sample - point).normalize();
-      auto lightDotNormal = dot(light_v, normal_v);
-
-      if (lightDotNormal < 0 or intensity == 0.0) {
-        // pass
-      } else {
-        diffuse = effective * this->diffuse_ * lightDotNormal;
+    const Point3 p(point);
+    const Vec3 eye(eye_v);
+    const Vec3 normal(normal_v);
 
-        auto reflect_v = -light_v.reflect(normal_v);
-        auto reflectDotEye = dot(reflect_v, eye_v);
+    Color sum(0, 0, 0);
+    if (intensity != 0.0) {
+      const Color light_intensity = light->intensity();
+      for (const auto& sample : samples) {
+        const Vec3 light_v = (Point3(sample) - p).normalize();
+        const double light_dot_normal = dot(light_v, normal);
+        if (light_dot_normal < 0) {
+          continue;
+        }
+        sum += effective * this->diffuse_ * light_dot_normal;
 
-        if (reflectDotEye <= 0) {
-          // pass
-        } else {
-          auto factor = pow(reflectDotEye, shininess_);
-          specular = light->intensity() * specular_ * factor;
+        const double reflect_dot_eye = dot(-light_v.reflect(normal), eye);
+        if (reflect_dot_eye > 0) {
+          sum += light_intensity * specular_ * pow(reflect_dot_eye, shininess_);
         }
       }
-      sum += diffuse;
-      sum += specular;
     }
     return ambient + (sum / samples.size()) * intensity;
   }
@@ -113,6 +113,19 @@ Tuple operator*(const Matrix &a, const Tuple &b) {
   };
 }
 
+Point3 operator*(const Matrix &a, const Point3 &b) {
+  return Point3(
+      a.get(0, 0) * b.x + a.get(0, 1) * b.y + a.get(0, 2) * b.z + a.get(0, 3),
+      a.get(1, 0) * b.x + a.get(1, 1) * b.y + a.get(1, 2) * b.z + a.get(1, 3),
+      a.get(2, 0) * b.x + a.get(2, 1) * b.y + a.get(2, 2) * b.z + a.get(2, 3));
+}
+
+Vec3 operator*(const Matrix &a, const Vec3 &b) {
+  return Vec3(a.get(0, 0) * b.x + a.get(0, 1) * b.y + a.get(0, 2) * b.z,
+              a.get(1, 0) * b.x + a.get(1, 1) * b.y + a.get(1, 2) * b.z,
+              a.get(2, 0) * b.x + a.get(2, 1) * b.y + a.get(2, 2) * b.z);
+}
+
 Matrix CreateTranslation(const double x, const double y, const double z) {
   Matrix out{IDENTITY};
   out.set(0, 3, x);
@@ -10,6 +10,7 @@
 //#include "folly/container/F14Map.h"
 
 #include "tuple.h"
+#include "vec3.h"
 
 using MatrixData4 = std::array<std::array<double, 4>, 4>;
 using MatrixData3 = std::array<std::array<double, 3>, 3>;
@@ -71,6 +72,11 @@ bool operator==(Matrix const &a, Matrix const &b);
 Matrix operator*(const Matrix &a, const Matrix &b);
 Tuple operator*(const Matrix &a, const Tuple &b);
 
+// Affine transforms of the w-less types: only the top three rows are used,
+// points pick up the translation column and vectors do not.
+Point3 operator*(const Matrix &a, const Point3 &b);
+Vec3 operator*(const Matrix &a, const Vec3 &b);
+
 Matrix CreateTranslation(const double x, const double y, const double z);
 
 Matrix CreateScaling(const double x, const double y, const double z);
@@ -10,16 +10,27 @@ class Shape;
 
 class Pattern {
  public:
-  explicit Pattern() : transform_{Matrix(IDENTITY)} {}
+  explicit Pattern()
+      : transform_{Matrix(IDENTITY)}, inverse_{Matrix(IDENTITY)} {}
   virtual ~Pattern() = default;
 
   virtual Color pattern_at(const Tuple& point) const = 0;
 
-  void set_transform(Matrix t) { transform_ = t; }
+  void set_transform(Matrix t) {
+    transform_ = t;
+    inverse_ = t.inverse();
+  }
   Matrix transform() const { return transform_; }
+  Matrix inverse() const { return inverse_; }
 
+  // Goes through the object's whole world-to-object transform, so that a
+  // pattern looks the same whether or not its groups have been flattened.
+  // Both inverses are cached (the object's once committed).
   Color pattern_at_object(Shape* obj, Tuple point) const;
   Matrix transform_;
+
+ private:
+  Matrix inverse_;
 };
 
 class TestPattern : public Pattern {
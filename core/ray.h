@@ -1,26 +1,35 @@
 #pragma once
 
+#include "affine_transform.h"
 #include "matrix.h"
 #include "tuple.h"
+#include "vec3.h"
 
 class Ray {
  public:
-  Ray(const Tuple origin, const Tuple direction)
+  Ray(const Point3& origin, const Vec3& direction)
       : origin_(origin), direction_(direction) {}
 
-  Tuple origin() const { return origin_; }
+  Ray(const Tuple& origin, const Tuple& direction)
+      : origin_(origin), direction_(direction) {}
+
+  const Point3& origin() const { return origin_; }
 
-  Tuple direction() const { return direction_; }
+  const Vec3& direction() const { return direction_; }
 
-  Tuple position(const double distance) const {
-    return origin_ + (direction_ * distance);
+  Point3 position(const double distance) const {
+    return origin_ + direction_ * distance;
   }
 
   Ray transform(const Matrix& m) const {
     return Ray(m * origin_, m * direction_);
   }
 
+  Ray transform(const AffineTransform& m) const {
+    return Ray(m * origin_, m * direction_);
+  }
+
  private:
-  Tuple origin_;
-  Tuple direction_;
+  Point3 origin_;
+  Vec3 direction_;
 };
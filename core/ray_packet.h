@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "linear_bvh.h"
+#include "ray.h"
+#include "simd.h"
+
+// Up to N coherent rays traced through a BVH together, stored
+// structure-of-arrays so a node's box is tested against every ray at once.
+// Lanes leave `active` when their ray is finished (e.g. a shadow ray found
+// an occluder), and each lane's [tmin, tmax] culls boxes independently.
+template <size_t N>
+struct RayPacket {
+  static_assert(N == 4 || N == 8 || N == 16,
+                "ray packets hold 4, 8 or 16 rays");
+
+  // rounded both ways, as in LinearBVHRay
+  alignas(64) float origin_down[3][N];
+  alignas(64) float origin_up[3][N];
+  alignas(64) float inv_direction[3][N];
+  alignas(64) float tmin[N];
+  alignas(64) float tmax[N];
+  unsigned active = 0;
+
+  // Near-child order follows the direction signs of the first ray; for a
+  // coherent packet they are the same for (almost) every lane.
+  bool negative[3] = {false, false, false};
+
+  RayPacket() {
+    for (size_t a = 0; a < 3; ++a) {
+      for (size_t i = 0; i < N; ++i) {
+        origin_down[a][i] = 0;
+        origin_up[a][i] = 0;
+        inv_direction[a][i] = 0;
+      }
+    }
+    for (size_t i = 0; i < N; ++i) {
+      tmin[i] = 0;
+      tmax[i] = -INFINITY;
+    }
+  }
+
+  void set(size_t lane, const Ray& r, double t0 = -INFINITY,
+           double t1 = INFINITY) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const double os[3] = {o.x, o.y, o.z};
+    const double ds[3] = {d.x, d.y, d.z};
+    for (size_t a = 0; a < 3; ++a) {
+      origin_down[a][lane] = float_round_down(os[a]);
+      origin_up[a][lane] = float_round_up(os[a]);
+      // -0 would turn into -inf and break the NaN handling in intersects()
+      auto f = static_cast<float>(ds[a]);
+      inv_direction[a][lane] = 1.0f / (f == 0.0f ? 0.0f : f);
+    }
+    tmin[lane] = float_round_down(t0);
+    tmax[lane] = float_round_up(t1);
+    if (active == 0) {
+      for (size_t a = 0; a < 3; ++a) {
+        negative[a] = inv_direction[a][lane] < 0;
+      }
+    }
+    active |= 1u << lane;
+  }
+
+  // Returns the active lanes whose ray enters `node` within its range.
+  // Parallel lanes have an inv_direction of +inf, so a ray lying in a slab
+  // plane gives NaN for one bound; the operand order below makes min/max
+  // drop it (see SimdFloat).
+  unsigned intersects(const LinearBVHNode& node) const {
+    using F = SimdFloat<N>;
+    auto near = F::load(tmin);
+    auto far = F::load(tmax);
+    for (size_t a = 0; a < 3; ++a) {
+      auto inv = F::load(inv_direction[a]);
+      auto t0 = (F::broadcast(node.min[a]) - F::load(origin_up[a])) * inv;
+      auto t1 = (F::broadcast(node.max[a]) - F::load(origin_down[a])) * inv;
+      near = max(min(t1, t0), near);
+      far = min(max(t0, t1), far);
+    }
+    return (near <= far) & active;
+  }
+};
+
+template <size_t N, typename LeafFn>
+void LinearBVH::traverse(RayPacket<N>* packet, LeafFn&& leaf) const {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  struct Entry {
+    uint32_t node;
+    unsigned mask;  // lanes that hit the parent
+  };
+
+  folly::small_vector<Entry, BVH_STACK_SIZE> stack;
+  stack.push_back({0, packet->active});
+
+  while (!stack.empty()) {
+    auto [current, mask] = stack.back();
+    stack.pop_back();
+    while (true) {
+      // lanes may have finished since this entry was pushed
+      mask &= packet->active;
+      if (mask == 0) {
+        break;
+      }
+      const auto& node = nodes_[current];
+      mask = packet->intersects(node) & mask;
+      if (mask == 0) {
+        break;
+      }
+      if (node.leaf()) {
+        leaf(node.offset, node.count, mask);
+        break;
+      }
+      if (packet->negative[node.axis]) {
+        stack.push_back({current + 1, mask});
+        current = node.offset;
+      } else {
+        stack.push_back({node.offset, mask});
+        current = current + 1;
+      }
+    }
+    if (packet->active == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+// The splitmix64 output function: a bijection whose every output bit
+// depends on every input bit. Good for turning counters into seeds.
+inline uint64_t mix_bits(uint64_t z) {
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// O'Neill's PCG32 (XSH RR on a 64 bit LCG). Small enough to make one per
+// sample: seeded from (frame, pixel) with the sample index as the stream,
+// the numbers a sample draws don't depend on which thread draws them or
+// in what order, so renders are the same on any number of threads.
+class Pcg32 {
+ public:
+  Pcg32(uint64_t seed, uint64_t stream) : inc_((stream << 1) | 1) {
+    next();
+    state_ += seed;
+    next();
+  }
+
+  uint32_t next() {
+    const auto old = state_;
+    state_ = old * MULTIPLIER + inc_;
+    const auto shifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    const auto rotation = static_cast<uint32_t>(old >> 59);
+    return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+  }
+
+  // Uniform in [0, 1), from two outputs.
+  double next_double() {
+    const uint64_t high = next();
+    return (((high << 32) | next()) >> 11) * 0x1p-53;
+  }
+
+  // Skips the next `delta` outputs in O(log delta) steps.
+  void advance(uint64_t delta) {
+    uint64_t multiplier = MULTIPLIER, increment = inc_;
+    uint64_t total_multiplier = 1, total_increment = 0;
+    for (; delta > 0; delta /= 2) {
+      if (delta & 1) {
+        total_multiplier *= multiplier;
+        total_increment = total_increment * multiplier + increment;
+      }
+      increment = (multiplier + 1) * increment;
+      multiplier *= multiplier;
+    }
+    state_ = total_multiplier * state_ + total_increment;
+  }
+
+ private:
+  static constexpr uint64_t MULTIPLIER = 6364136223846793005ull;
+
+  uint64_t state_ = 0;
+  uint64_t inc_;
+};
@@ -0,0 +1,295 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "rng.h"
+
+namespace {
+thread_local SampleContext context;
+
+uint64_t hash(uint64_t a, uint64_t b, uint64_t c = 0, uint64_t d = 0) {
+  return mix_bits(a ^ mix_bits(b ^ mix_bits(c ^ mix_bits(d))));
+}
+
+double unit(uint64_t bits) { return (bits >> 11) * 0x1p-53; }
+
+// The largest double below 1.
+constexpr double ONE_MINUS_EPSILON = 0x1.fffffffffffffp-1;
+
+uint32_t pair_of(SampleDimension d) { return static_cast<uint32_t>(d) / 2; }
+uint32_t axis_of(SampleDimension d) { return static_cast<uint32_t>(d) % 2; }
+
+// Kensler's hashed permutation of [0, n) ("Correlated Multi-Jittered
+// Sampling"); cycle walks the smallest power of two holding n.
+uint32_t permute(uint32_t i, uint32_t n, uint32_t p) {
+  uint32_t w = n - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  do {
+    i ^= p;
+    i *= 0xe170893d;
+    i ^= p >> 16;
+    i ^= (i & w) >> 4;
+    i ^= p >> 8;
+    i *= 0x0929eb3f;
+    i ^= p >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | p >> 27;
+    i *= 0x6935fa69;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3df;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= n);
+  return (i + p) % n;
+}
+
+double radical_inverse(uint32_t base, uint64_t i) {
+  const double inverse = 1.0 / base;
+  double f = inverse;
+  double out = 0.0;
+  for (; i > 0; i /= base) {
+    out += (i % base) * f;
+    f *= inverse;
+  }
+  return out;
+}
+
+uint32_t reverse_bits(uint32_t x) {
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// Sobol dimension 0 (van der Corput) or 1, as 32 bit fractions.
+uint32_t sobol(uint32_t i, uint32_t dimension) {
+  if (dimension == 0) {
+    return reverse_bits(i);
+  }
+  uint32_t out = 0;
+  for (uint32_t v = 1u << 31; i != 0; i >>= 1, v ^= v >> 1) {
+    if (i & 1) {
+      out ^= v;
+    }
+  }
+  return out;
+}
+
+// Owen scrambling by hashing: every bit is flipped depending only on the
+// bits above it (Burley's variant of the Laine-Karras permutation).
+uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+  x = reverse_bits(x);
+  x ^= x * 0x3d20adea;
+  x += seed;
+  x *= (seed >> 16) | 1;
+  x ^= x * 0x05526c56;
+  x ^= x * 0x53a22864;
+  return reverse_bits(x);
+}
+
+// The index-th point of the (0, 2)-sequence, scrambled with `seed`.
+double scrambled_sobol(uint64_t index, SampleDimension d, uint64_t seed) {
+  auto i = owen_scramble(static_cast<uint32_t>(index),
+                         static_cast<uint32_t>(seed));
+  auto bits = owen_scramble(sobol(i, axis_of(d)),
+                            static_cast<uint32_t>(hash(seed, axis_of(d))));
+  return bits * 0x1p-32;
+}
+
+double wrap(double v) { return v >= 1.0 ? v - 1.0 : v; }
+
+// Ulichney's void-and-cluster method on a torus: relax a sparse random
+// pattern until its tightest cluster is also its largest void, rank its
+// points by removing the tightest cluster over and over, then rank the
+// rest by filling the largest void over and over.
+std::vector<float> build_blue_noise() {
+  constexpr int N = BLUE_NOISE_SIZE;
+  constexpr int COUNT = N * N;
+  constexpr double SIGMA = 1.9;
+
+  std::vector<double> kernel(COUNT);
+  for (int dy = 0; dy < N; ++dy) {
+    for (int dx = 0; dx < N; ++dx) {
+      double x = std::min(dx, N - dx);
+      double y = std::min(dy, N - dy);
+      kernel[dy * N + dx] = std::exp(-(x * x + y * y) / (2 * SIGMA * SIGMA));
+    }
+  }
+
+  std::vector<char> on(COUNT, 0);
+  std::vector<double> energy(COUNT, 0.0);
+  auto set = [&](int p, bool value) {
+    on[p] = value;
+    const double sign = value ? 1.0 : -1.0;
+    const int px = p % N;
+    const int py = p / N;
+    for (int y = 0; y < N; ++y) {
+      const double* row = &kernel[((y - py + N) % N) * N];
+      for (int x = 0; x < N; ++x) {
+        energy[y * N + x] += sign * row[(x - px + N) % N];
+      }
+    }
+  };
+  auto tightest_cluster = [&] {
+    int out = -1;
+    for (int p = 0; p < COUNT; ++p) {
+      if (on[p] && (out < 0 || energy[p] > energy[out])) {
+        out = p;
+      }
+    }
+    return out;
+  };
+  auto largest_void = [&] {
+    int out = -1;
+    for (int p = 0; p < COUNT; ++p) {
+      if (!on[p] && (out < 0 || energy[p] < energy[out])) {
+        out = p;
+      }
+    }
+    return out;
+  };
+
+  const int initial = COUNT / 10;
+  for (int i = 0, placed = 0; placed < initial; ++i) {
+    auto p = static_cast<int>(mix_bits(i) % COUNT);
+    if (!on[p]) {
+      set(p, true);
+      ++placed;
+    }
+  }
+  for (int i = 0; i < COUNT; ++i) {
+    auto cluster = tightest_cluster();
+    set(cluster, false);
+    auto hole = largest_void();
+    set(hole, true);
+    if (hole == cluster) {
+      break;
+    }
+  }
+
+  std::vector<int> rank(COUNT);
+  const auto relaxed = on;
+  const auto relaxed_energy = energy;
+  for (int r = initial - 1; r >= 0; --r) {
+    auto cluster = tightest_cluster();
+    set(cluster, false);
+    rank[cluster] = r;
+  }
+  on = relaxed;
+  energy = relaxed_energy;
+  for (int r = initial; r < COUNT; ++r) {
+    auto hole = largest_void();
+    set(hole, true);
+    rank[hole] = r;
+  }
+
+  std::vector<float> out(COUNT);
+  for (int p = 0; p < COUNT; ++p) {
+    out[p] = (rank[p] + 0.5f) / COUNT;
+  }
+  return out;
+}
+}  // namespace
+
+uint64_t Sampler::pixel_seed(uint32_t x, uint32_t y) const {
+  return hash(x, y, seed_);
+}
+
+double RandomSampler::get(uint32_t x, uint32_t y, uint64_t index,
+                          SampleDimension d) const {
+  // a stream per sample, and two outputs per dimension
+  Pcg32 rng(pixel_seed(x, y), index);
+  rng.advance(2 * static_cast<uint64_t>(d));
+  return rng.next_double();
+}
+
+StratifiedSampler::StratifiedSampler(size_t samples, uint64_t seed)
+    : Sampler(seed), side_(1) {
+  while (size_t(side_) * side_ < samples) {
+    ++side_;
+  }
+}
+
+double StratifiedSampler::get(uint32_t x, uint32_t y, uint64_t index,
+                              SampleDimension d) const {
+  const uint32_t cells = side_ * side_;
+  // past the first cells samples, each further run gets its own shuffle
+  const auto seed = hash(pixel_seed(x, y), pair_of(d), index / cells);
+  const auto cell = permute(index % cells, cells, static_cast<uint32_t>(seed));
+  const auto stratum = axis_of(d) == 0 ? cell % side_ : cell / side_;
+  return std::min(
+      (stratum + unit(hash(seed, cell, axis_of(d) + 1))) / side_,
+      ONE_MINUS_EPSILON);
+}
+
+double HaltonSampler::get(uint32_t x, uint32_t y, uint64_t index,
+                          SampleDimension d) const {
+  static constexpr uint32_t PRIMES[] = {2, 3, 5, 7, 11, 13};
+  const auto dimension = static_cast<uint32_t>(d);
+  return wrap(radical_inverse(PRIMES[dimension], index) +
+              unit(hash(pixel_seed(x, y), dimension)));
+}
+
+double SobolSampler::get(uint32_t x, uint32_t y, uint64_t index,
+                         SampleDimension d) const {
+  return scrambled_sobol(index, d, hash(pixel_seed(x, y), pair_of(d)));
+}
+
+double BlueNoiseSampler::get(uint32_t x, uint32_t y, uint64_t index,
+                             SampleDimension d) const {
+  // one scramble for the whole image; each dimension reads the mask at its
+  // own offset so that they don't all shift together
+  const auto dimension = static_cast<uint32_t>(d);
+  const auto offset = hash(dimension, seed_);
+  return wrap(scrambled_sobol(index, d, hash(pair_of(d), seed_, 1)) +
+              blue_noise(x + static_cast<uint32_t>(offset),
+                         y + static_cast<uint32_t>(offset >> 32)));
+}
+
+double blue_noise(uint32_t x, uint32_t y) {
+  static const std::vector<float> mask = build_blue_noise();
+  return mask[(y % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + x % BLUE_NOISE_SIZE];
+}
+
+std::unique_ptr<Sampler> make_sampler(const std::string& name,
+                                      size_t samples,
+                                      uint64_t seed) {
+  if (name == "random") {
+    return std::make_unique<RandomSampler>(seed);
+  }
+  if (name == "stratified") {
+    return std::make_unique<StratifiedSampler>(samples, seed);
+  }
+  if (name == "halton") {
+    return std::make_unique<HaltonSampler>(seed);
+  }
+  if (name == "sobol") {
+    return std::make_unique<SobolSampler>(seed);
+  }
+  if (name == "bluenoise") {
+    return std::make_unique<BlueNoiseSampler>(seed);
+  }
+  throw std::runtime_error("unknown sampler: " + name);
+}
+
+const SampleContext& current_sample() { return context; }
+
+SampleScope::SampleScope(const Sampler* sampler, uint32_t x, uint32_t y,
+                         uint64_t index)
+    : saved_(context) {
+  context = {sampler, x, y, index};
+}
+
+SampleScope::~SampleScope() { context = saved_; }
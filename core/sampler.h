@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// The random numbers a camera sample consumes, one dimension each. They
+// come in pairs that are sampled together (the position within the pixel,
+// on an area light, on a lens), so samplers that stratify in 2D do it per
+// pair. LENS_U and LENS_V are reserved for a thin lens camera.
+enum class SampleDimension : uint32_t {
+  PIXEL_X,
+  PIXEL_Y,
+  LIGHT_U,
+  LIGHT_V,
+  LENS_U,
+  LENS_V,
+};
+
+// Where sample values come from. get() is a pure function of the seed and
+// its arguments, so a sampler is shared by all the render threads, needs no
+// per-thread state, and gives the same image however the pixels are
+// scheduled. Seed with the frame number to vary the noise over an
+// animation.
+class Sampler {
+ public:
+  explicit Sampler(uint64_t seed) : seed_(seed) {}
+  virtual ~Sampler() = default;
+
+  uint64_t seed() const { return seed_; }
+
+  // Component `d` of the index-th sample of pixel (x, y), in [0, 1).
+  virtual double get(uint32_t x, uint32_t y, uint64_t index,
+                     SampleDimension d) const = 0;
+
+ protected:
+  // Hash of the seed and the pixel.
+  uint64_t pixel_seed(uint32_t x, uint32_t y) const;
+
+  const uint64_t seed_;
+};
+
+// Independent uniform values from a PCG32 stream per (seed, pixel, sample).
+class RandomSampler : public Sampler {
+ public:
+  explicit RandomSampler(uint64_t seed = 0) : Sampler(seed) {}
+
+  double get(uint32_t x, uint32_t y, uint64_t index,
+             SampleDimension d) const override;
+};
+
+// Jittered strata: each run of n x n consecutive samples, n the smallest
+// square root at or above `samples`, puts one sample in every cell of an
+// n x n grid over each dimension pair. The cells are visited in a
+// different shuffled order for every pixel and pair.
+class StratifiedSampler : public Sampler {
+ public:
+  explicit StratifiedSampler(size_t samples, uint64_t seed = 0);
+
+  double get(uint32_t x, uint32_t y, uint64_t index,
+             SampleDimension d) const override;
+
+ private:
+  uint32_t side_;
+};
+
+// The Halton sequence, one prime base per dimension, shifted by a random
+// offset per pixel and dimension (Cranley-Patterson rotation) so that
+// neighbouring pixels don't repeat the same pattern.
+class HaltonSampler : public Sampler {
+ public:
+  explicit HaltonSampler(uint64_t seed = 0) : Sampler(seed) {}
+
+  double get(uint32_t x, uint32_t y, uint64_t index,
+             SampleDimension d) const override;
+};
+
+// The first two Sobol dimensions, a (0, 2)-sequence, for every dimension
+// pair, with a hashed Owen scramble of the points and of the sample order
+// per pixel and pair (Burley, "Practical Hash-based Owen Scrambling").
+// Any power of two of consecutive samples is stratified in every
+// elementary interval of the pair.
+class SobolSampler : public Sampler {
+ public:
+  explicit SobolSampler(uint64_t seed = 0) : Sampler(seed) {}
+
+  double get(uint32_t x, uint32_t y, uint64_t index,
+             SampleDimension d) const override;
+};
+
+// The same scrambled Sobol points in every pixel, rotated per pixel by the
+// value of a blue noise mask (Georgiev and Fajardo, "Blue-noise Dithered
+// Sampling"). Each pixel converges as fast as with SobolSampler, but what
+// error is left is spread as high frequency noise the eye averages out
+// instead of as blotches.
+class BlueNoiseSampler : public Sampler {
+ public:
+  explicit BlueNoiseSampler(uint64_t seed = 0) : Sampler(seed) {}
+
+  double get(uint32_t x, uint32_t y, uint64_t index,
+             SampleDimension d) const override;
+};
+
+// Size of the blue noise mask, which tiles the image.
+constexpr uint32_t BLUE_NOISE_SIZE = 64;
+
+// The mask at (x, y), wrapping around: every value (i + 0.5) / 64^2 appears
+// once per tile, arranged by void-and-cluster so that values close in the
+// mask are far apart. Built on first use.
+double blue_noise(uint32_t x, uint32_t y);
+
+// "random", "stratified", "halton", "sobol" or "bluenoise"; `samples` is
+// the number of samples per pixel the sampler is tuned for. Throws
+// std::runtime_error on an unknown name.
+std::unique_ptr<Sampler> make_sampler(const std::string& name, size_t samples,
+                                      uint64_t seed = 0);
+
+// The sample the calling thread is tracing, for code the sampler can't be
+// passed to directly (area lights, deep inside World::color_at()). Set for
+// the lifetime of a SampleScope; `sampler` is null outside any.
+struct SampleContext {
+  const Sampler* sampler = nullptr;
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint64_t index = 0;
+};
+
+const SampleContext& current_sample();
+
+class SampleScope {
+ public:
+  SampleScope(const Sampler* sampler, uint32_t x, uint32_t y, uint64_t index);
+  ~SampleScope();
+
+  SampleScope(const SampleScope&) = delete;
+  SampleScope& operator=(const SampleScope&) = delete;
+
+ private:
+  SampleContext saved_;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// N floats processed together: an SSE register for N = 4, AVX for 8 and
+// AVX-512 for 16 when the target has them, otherwise a plain array the
+// compiler is free to vectorise. Loads and stores must be aligned to the
+// register size.
+//
+// min() and max() follow the x86 rule of returning the second operand when
+// either is NaN; kernels rely on this to drop the 0 * inf of an
+// axis-parallel ray. Comparisons return a bitmask with bit i set for lane i.
+template <size_t N>
+struct SimdFloat {
+  float v[N];
+
+  static SimdFloat broadcast(float f) {
+    SimdFloat out;
+    for (size_t i = 0; i < N; ++i) {
+      out.v[i] = f;
+    }
+    return out;
+  }
+
+  static SimdFloat load(const float* p) {
+    SimdFloat out;
+    for (size_t i = 0; i < N; ++i) {
+      out.v[i] = p[i];
+    }
+    return out;
+  }
+
+  void store(float* p) const {
+    for (size_t i = 0; i < N; ++i) {
+      p[i] = v[i];
+    }
+  }
+
+#define SIMD_FLOAT_OP(op)                                      \
+  friend SimdFloat operator op(SimdFloat a, const SimdFloat& b) { \
+    for (size_t i = 0; i < N; ++i) {                           \
+      a.v[i] = a.v[i] op b.v[i];                               \
+    }                                                          \
+    return a;                                                  \
+  }
+  SIMD_FLOAT_OP(+)
+  SIMD_FLOAT_OP(-)
+  SIMD_FLOAT_OP(*)
+  SIMD_FLOAT_OP(/)
+#undef SIMD_FLOAT_OP
+
+  friend SimdFloat min(SimdFloat a, const SimdFloat& b) {
+    for (size_t i = 0; i < N; ++i) {
+      a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+    }
+    return a;
+  }
+
+  friend SimdFloat max(SimdFloat a, const SimdFloat& b) {
+    for (size_t i = 0; i < N; ++i) {
+      a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    }
+    return a;
+  }
+
+  friend SimdFloat sqrt(SimdFloat a) {
+    for (size_t i = 0; i < N; ++i) {
+      a.v[i] = std::sqrt(a.v[i]);
+    }
+    return a;
+  }
+
+#define SIMD_FLOAT_CMP(op)                                          \
+  friend unsigned operator op(const SimdFloat& a, const SimdFloat& b) { \
+    unsigned out = 0;                                               \
+    for (size_t i = 0; i < N; ++i) {                                \
+      out |= unsigned(a.v[i] op b.v[i]) << i;                       \
+    }                                                               \
+    return out;                                                     \
+  }
+  SIMD_FLOAT_CMP(<)
+  SIMD_FLOAT_CMP(<=)
+  SIMD_FLOAT_CMP(>)
+  SIMD_FLOAT_CMP(>=)
+#undef SIMD_FLOAT_CMP
+};
+
+#if defined(__SSE2__)
+template <>
+struct SimdFloat<4> {
+  __m128 v;
+
+  static SimdFloat broadcast(float f) { return {_mm_set1_ps(f)}; }
+  static SimdFloat load(const float* p) { return {_mm_load_ps(p)}; }
+  void store(float* p) const { _mm_store_ps(p, v); }
+
+  friend SimdFloat operator+(SimdFloat a, SimdFloat b) {
+    return {_mm_add_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator-(SimdFloat a, SimdFloat b) {
+    return {_mm_sub_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator*(SimdFloat a, SimdFloat b) {
+    return {_mm_mul_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator/(SimdFloat a, SimdFloat b) {
+    return {_mm_div_ps(a.v, b.v)};
+  }
+  friend SimdFloat min(SimdFloat a, SimdFloat b) {
+    return {_mm_min_ps(a.v, b.v)};
+  }
+  friend SimdFloat max(SimdFloat a, SimdFloat b) {
+    return {_mm_max_ps(a.v, b.v)};
+  }
+  friend SimdFloat sqrt(SimdFloat a) { return {_mm_sqrt_ps(a.v)}; }
+
+  friend unsigned operator<(SimdFloat a, SimdFloat b) {
+    return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v));
+  }
+  friend unsigned operator<=(SimdFloat a, SimdFloat b) {
+    return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v));
+  }
+  friend unsigned operator>(SimdFloat a, SimdFloat b) {
+    return _mm_movemask_ps(_mm_cmpgt_ps(a.v, b.v));
+  }
+  friend unsigned operator>=(SimdFloat a, SimdFloat b) {
+    return _mm_movemask_ps(_mm_cmpge_ps(a.v, b.v));
+  }
+};
+#endif
+
+#if defined(__AVX__)
+template <>
+struct SimdFloat<8> {
+  __m256 v;
+
+  static SimdFloat broadcast(float f) { return {_mm256_set1_ps(f)}; }
+  static SimdFloat load(const float* p) { return {_mm256_load_ps(p)}; }
+  void store(float* p) const { _mm256_store_ps(p, v); }
+
+  friend SimdFloat operator+(SimdFloat a, SimdFloat b) {
+    return {_mm256_add_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator-(SimdFloat a, SimdFloat b) {
+    return {_mm256_sub_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator*(SimdFloat a, SimdFloat b) {
+    return {_mm256_mul_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator/(SimdFloat a, SimdFloat b) {
+    return {_mm256_div_ps(a.v, b.v)};
+  }
+  friend SimdFloat min(SimdFloat a, SimdFloat b) {
+    return {_mm256_min_ps(a.v, b.v)};
+  }
+  friend SimdFloat max(SimdFloat a, SimdFloat b) {
+    return {_mm256_max_ps(a.v, b.v)};
+  }
+  friend SimdFloat sqrt(SimdFloat a) { return {_mm256_sqrt_ps(a.v)}; }
+
+  friend unsigned operator<(SimdFloat a, SimdFloat b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ));
+  }
+  friend unsigned operator<=(SimdFloat a, SimdFloat b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ));
+  }
+  friend unsigned operator>(SimdFloat a, SimdFloat b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ));
+  }
+  friend unsigned operator>=(SimdFloat a, SimdFloat b) {
+    return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ));
+  }
+};
+#endif
+
+#if defined(__AVX512F__)
+template <>
+struct SimdFloat<16> {
+  __m512 v;
+
+  static SimdFloat broadcast(float f) { return {_mm512_set1_ps(f)}; }
+  static SimdFloat load(const float* p) { return {_mm512_load_ps(p)}; }
+  void store(float* p) const { _mm512_store_ps(p, v); }
+
+  friend SimdFloat operator+(SimdFloat a, SimdFloat b) {
+    return {_mm512_add_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator-(SimdFloat a, SimdFloat b) {
+    return {_mm512_sub_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator*(SimdFloat a, SimdFloat b) {
+    return {_mm512_mul_ps(a.v, b.v)};
+  }
+  friend SimdFloat operator/(SimdFloat a, SimdFloat b) {
+    return {_mm512_div_ps(a.v, b.v)};
+  }
+  friend SimdFloat min(SimdFloat a, SimdFloat b) {
+    return {_mm512_min_ps(a.v, b.v)};
+  }
+  friend SimdFloat max(SimdFloat a, SimdFloat b) {
+    return {_mm512_max_ps(a.v, b.v)};
+  }
+  friend SimdFloat sqrt(SimdFloat a) { return {_mm512_sqrt_ps(a.v)}; }
+
+  friend unsigned operator<(SimdFloat a, SimdFloat b) {
+    return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ);
+  }
+  friend unsigned operator<=(SimdFloat a, SimdFloat b) {
+    return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ);
+  }
+  friend unsigned operator>(SimdFloat a, SimdFloat b) {
+    return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ);
+  }
+  friend unsigned operator>=(SimdFloat a, SimdFloat b) {
+    return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ);
+  }
+};
+#endif
@@ -0,0 +1,118 @@
+#include "tiles.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+uint64_t morton_index(uint32_t x, uint32_t y) {
+  uint64_t out = 0;
+  for (uint32_t bit = 0; bit < 32; ++bit) {
+    out |= uint64_t((x >> bit) & 1) << (2 * bit);
+    out |= uint64_t((y >> bit) & 1) << (2 * bit + 1);
+  }
+  return out;
+}
+
+// Position of (x, y) along the Hilbert curve filling an n x n grid, n a
+// power of two.
+uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y) {
+  uint64_t out = 0;
+  for (uint32_t s = n / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    out += uint64_t(s) * s * ((3 * rx) ^ ry);
+    // rotate the quadrant so the curve inside it starts where we enter
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return out;
+}
+}  // namespace
+
+TileOrder tile_order_from(const std::string& name) {
+  if (name == "scanline") {
+    return TileOrder::SCANLINE;
+  }
+  if (name == "morton") {
+    return TileOrder::MORTON;
+  }
+  if (name == "hilbert") {
+    return TileOrder::HILBERT;
+  }
+  throw std::runtime_error("unknown tile order: " + name);
+}
+
+std::vector<Tile> make_tiles(size_t width, size_t height, size_t tile_size,
+                             TileOrder order) {
+  if (tile_size == 0) {
+    throw std::runtime_error("tile size must be at least 1");
+  }
+  const auto columns = uint32_t((width + tile_size - 1) / tile_size);
+  const auto rows = uint32_t((height + tile_size - 1) / tile_size);
+  uint32_t n = 1;
+  while (n < std::max(columns, rows)) {
+    n *= 2;
+  }
+
+  std::vector<std::pair<uint64_t, Tile>> keyed;
+  keyed.reserve(size_t(columns) * rows);
+  for (uint32_t row = 0; row < rows; ++row) {
+    for (uint32_t column = 0; column < columns; ++column) {
+      Tile tile{uint32_t(column * tile_size), uint32_t(row * tile_size),
+                uint32_t(std::min((column + 1) * tile_size, width)),
+                uint32_t(std::min((row + 1) * tile_size, height))};
+      uint64_t key = uint64_t(row) * columns + column;
+      if (order == TileOrder::MORTON) {
+        key = morton_index(column, row);
+      } else if (order == TileOrder::HILBERT) {
+        key = hilbert_index(n, column, row);
+      }
+      keyed.emplace_back(key, tile);
+    }
+  }
+  std::sort(keyed.begin(), keyed.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  std::vector<Tile> out;
+  out.reserve(keyed.size());
+  for (const auto& [key, tile] : keyed) {
+    out.push_back(tile);
+  }
+  return out;
+}
+
+std::ostream& operator<<(std::ostream& os, const RenderStats& stats) {
+  os << stats.tiles.size() << " tiles on " << stats.threads << " threads in "
+     << stats.millis << " ms";
+  if (stats.rays > 0) {
+    os << ", " << stats.rays << " camera rays";
+  }
+  if (stats.tiles.empty()) {
+    return os;
+  }
+
+  std::vector<double> millis;
+  std::vector<double> busy(stats.threads, 0.0);
+  for (const auto& t : stats.tiles) {
+    millis.push_back(t.millis);
+    if (t.thread >= 0 && size_t(t.thread) < busy.size()) {
+      busy[t.thread] += t.millis;
+    }
+  }
+  std::sort(millis.begin(), millis.end());
+  double total = 0.0;
+  for (auto m : millis) {
+    total += m;
+  }
+  auto busiest = *std::max_element(busy.begin(), busy.end());
+  return os << "; per tile min " << millis.front() << " / median "
+            << millis[millis.size() / 2] << " / max " << millis.back()
+            << " ms; threads busy " << total / stats.threads << " ms on "
+            << "average, " << busiest << " ms at most";
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+
+// The order tiles are handed out in. MORTON and HILBERT keep consecutive
+// tiles close together on screen, so a thread working through a run of
+// them stays in one part of the scene (and of the BVH) and finds it in
+// its caches; HILBERT never jumps, MORTON is cheaper to compute.
+enum class TileOrder { SCANLINE, MORTON, HILBERT };
+
+// Parses "scanline", "morton" or "hilbert". Throws std::runtime_error on
+// anything else.
+TileOrder tile_order_from(const std::string& name);
+
+// Pixels [x0, x1) x [y0, y1) of an image.
+struct Tile {
+  uint32_t x0, y0, x1, y1;
+
+  uint32_t width() const { return x1 - x0; }
+  uint32_t height() const { return y1 - y0; }
+};
+
+// Tiles of at most tile_size x tile_size pixels covering a width x height
+// image, in the given order.
+std::vector<Tile> make_tiles(size_t width, size_t height, size_t tile_size,
+                             TileOrder order);
+
+struct TileTiming {
+  Tile tile;
+  double millis;
+  int thread;  // index within the arena that ran the tile
+};
+
+// What run_tiles() measured; operator<< prints a summary.
+struct RenderStats {
+  std::vector<TileTiming> tiles;  // in the order they were handed out
+  double millis = 0.0;            // wall clock for the whole run
+  size_t threads = 0;
+  uint64_t rays = 0;  // camera rays, if the caller counts them
+};
+
+std::ostream& operator<<(std::ostream& os, const RenderStats& stats);
+
+// Calls fn(tile) once per tile on `threads` threads (0 for one per core)
+// and records how long each call took. TBB splits the tile list in halves
+// down to single tiles; a thread works through its own half in order and
+// an idle thread steals the largest untouched half from a busy one, so
+// every thread keeps to a contiguous, and for MORTON or HILBERT compact,
+// run of tiles. fn runs concurrently and must only write its own tile.
+template <typename Fn>
+RenderStats run_tiles(const std::vector<Tile>& tiles, size_t threads,
+                      Fn&& fn) {
+  using clock = std::chrono::steady_clock;
+  auto millis = [](clock::time_point a, clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+  };
+
+  RenderStats stats;
+  stats.tiles.resize(tiles.size());
+  tbb::task_arena arena(threads == 0 ? tbb::task_arena::automatic
+                                     : static_cast<int>(threads));
+  stats.threads = arena.max_concurrency();
+
+  const auto start = clock::now();
+  arena.execute([&] {
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, tiles.size(), 1),
+        [&](const tbb::blocked_range<size_t>& r) {
+          for (size_t i = r.begin(); i != r.end(); ++i) {
+            const auto begin = clock::now();
+            fn(tiles[i]);
+            stats.tiles[i] = {tiles[i], millis(begin, clock::now()),
+                              tbb::this_task_arena::current_thread_index()};
+          }
+        },
+        tbb::simple_partitioner());
+  });
+  stats.millis = millis(start, clock::now());
+  return stats;
+}
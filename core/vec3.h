@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cmath>
+#include <ostream>
+
+#include "tuple.h"
+
+// Scalar type of the ray math below (rays, transforms, triangle and sphere
+// tests, shading vectors). Double unless the build defines
+// RAYTRACE_SINGLE_PRECISION, as the raytrace_lib_float target does. Tuple,
+// Matrix and Color, which describe the scene rather than trace it, stay
+// double either way.
+#if defined(RAYTRACE_SINGLE_PRECISION)
+using Real = float;
+#else
+using Real = double;
+#endif
+
+// Three-component math types for the hot paths. Unlike Tuple there is no
+// w: points and directions are told apart by type instead, so a direction
+// is three numbers rather than four and nothing ever multiplies a w. Every
+// operation is inline, leaving the compiler free to keep values in
+// registers and to vectorise.
+//
+// Tuples convert implicitly to these types' Tuple form (for the rest of
+// the code) and explicitly the other way.
+template <typename T>
+struct Vec3T {
+  T x, y, z;
+
+  constexpr Vec3T() : x{0}, y{0}, z{0} {}
+  constexpr Vec3T(T x, T y, T z) : x{x}, y{y}, z{z} {}
+  explicit Vec3T(const Tuple& t) : x(t.x), y(t.y), z(t.z) {}
+  operator Tuple() const { return Tuple::vector(x, y, z); }
+
+  Vec3T& operator+=(const Vec3T& b) {
+    x += b.x;
+    y += b.y;
+    z += b.z;
+    return *this;
+  }
+  Vec3T& operator-=(const Vec3T& b) {
+    x -= b.x;
+    y -= b.y;
+    z -= b.z;
+    return *this;
+  }
+  Vec3T& operator*=(T s) {
+    x *= s;
+    y *= s;
+    z *= s;
+    return *this;
+  }
+  Vec3T& operator/=(T s) { return *this *= T(1) / s; }
+
+  friend Vec3T operator+(Vec3T a, const Vec3T& b) { return a += b; }
+  friend Vec3T operator-(Vec3T a, const Vec3T& b) { return a -= b; }
+  friend Vec3T operator*(Vec3T a, T s) { return a *= s; }
+  friend Vec3T operator*(T s, Vec3T a) { return a *= s; }
+  friend Vec3T operator/(Vec3T a, T s) { return a /= s; }
+  friend Vec3T operator-(const Vec3T& a) { return {-a.x, -a.y, -a.z}; }
+
+  T length_squared() const { return x * x + y * y + z * z; }
+  T magnitude() const { return std::sqrt(length_squared()); }
+  Vec3T normalize() const { return *this / magnitude(); }
+
+  // Mirror image about the normal n.
+  Vec3T reflect(const Vec3T& n) const { return *this - n * (2 * dot(*this, n)); }
+
+  friend T dot(const Vec3T& a, const Vec3T& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+  }
+  friend Vec3T cross(const Vec3T& a, const Vec3T& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x};
+  }
+};
+
+template <typename T>
+struct Point3T {
+  T x, y, z;
+
+  constexpr Point3T() : x{0}, y{0}, z{0} {}
+  constexpr Point3T(T x, T y, T z) : x{x}, y{y}, z{z} {}
+  explicit Point3T(const Tuple& t) : x(t.x), y(t.y), z(t.z) {}
+  operator Tuple() const { return Tuple::point(x, y, z); }
+
+  Point3T& operator+=(const Vec3T<T>& v) {
+    x += v.x;
+    y += v.y;
+    z += v.z;
+    return *this;
+  }
+  Point3T& operator-=(const Vec3T<T>& v) {
+    x -= v.x;
+    y -= v.y;
+    z -= v.z;
+    return *this;
+  }
+
+  friend Point3T operator+(Point3T p, const Vec3T<T>& v) { return p += v; }
+  friend Point3T operator-(Point3T p, const Vec3T<T>& v) { return p -= v; }
+  friend Vec3T<T> operator-(const Point3T& a, const Point3T& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+  }
+};
+
+// A surface normal. Kept apart from Vec3T because normals transform by the
+// inverse transpose rather than by the matrix itself.
+template <typename T>
+struct Normal3T {
+  T x, y, z;
+
+  constexpr Normal3T() : x{0}, y{0}, z{0} {}
+  constexpr Normal3T(T x, T y, T z) : x{x}, y{y}, z{z} {}
+  explicit Normal3T(const Vec3T<T>& v) : x(v.x), y(v.y), z(v.z) {}
+  explicit Normal3T(const Tuple& t) : x(t.x), y(t.y), z(t.z) {}
+  operator Tuple() const { return Tuple::vector(x, y, z); }
+
+  Vec3T<T> vec() const { return {x, y, z}; }
+
+  friend Normal3T operator-(const Normal3T& n) { return {-n.x, -n.y, -n.z}; }
+  friend T dot(const Normal3T& n, const Vec3T<T>& v) { return dot(n.vec(), v); }
+  friend T dot(const Vec3T<T>& v, const Normal3T& n) { return dot(v, n.vec()); }
+};
+
+template <typename T>
+bool operator==(const Vec3T<T>& a, const Vec3T<T>& b) {
+  return eq(a.x, b.x) && eq(a.y, b.y) && eq(a.z, b.z);
+}
+
+template <typename T>
+bool operator==(const Point3T<T>& a, const Point3T<T>& b) {
+  return eq(a.x, b.x) && eq(a.y, b.y) && eq(a.z, b.z);
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const Vec3T<T>& v) {
+  return os << "Vec3(" << v.x << ", " << v.y << ", " << v.z << ")";
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const Point3T<T>& p) {
+  return os << "Point3(" << p.x << ", " << p.y << ", " << p.z << ")";
+}
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const Normal3T<T>& n) {
+  return os << "Normal3(" << n.x << ", " << n.y << ", " << n.z << ")";
+}
+
+using Vec3 = Vec3T<Real>;
+using Point3 = Point3T<Real>;
+using Normal3 = Normal3T<Real>;
+
+using Vec3f = Vec3T<float>;
+using Point3f = Point3T<float>;
+using Normal3f = Normal3T<float>;
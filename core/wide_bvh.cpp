@@ -0,0 +1,208 @@
+#include "wide_bvh.h"
+
+#include <algorithm>
+
+#include "../shapes/primitive.h"
+#include "../shapes/shape.h"
+
+namespace {
+float surface_area(const LinearBVHNode& n) {
+  float dx = n.max[0] - n.min[0];
+  float dy = n.max[1] - n.min[1];
+  float dz = n.max[2] - n.min[2];
+  return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+}  // namespace
+
+template <size_t N>
+WideBVH<N>::WideBVH(const LinearBVH& bvh)
+    : primitives_(bvh.primitives()), kinds_(bvh.kinds()) {
+  const auto& binary = bvh.nodes();
+  if (binary.empty()) {
+    return;
+  }
+  if (binary[0].leaf()) {
+    // a single leaf still needs a root node to hang it from
+    nodes_.emplace_back();
+    nodes_[0].valid = 0;
+    set_slot(&nodes_[0], 0, binary[0]);
+    nodes_[0].child[0] = binary[0].offset;
+    nodes_[0].count[0] = binary[0].count;
+    return;
+  }
+  collapse(bvh, 0);
+}
+
+template <size_t N>
+void WideBVH<N>::set_slot(Node* node, size_t slot,
+                          const LinearBVHNode& source) {
+  node->min_x[slot] = source.min[0];
+  node->min_y[slot] = source.min[1];
+  node->min_z[slot] = source.min[2];
+  node->max_x[slot] = source.max[0];
+  node->max_y[slot] = source.max[1];
+  node->max_z[slot] = source.max[2];
+  node->valid |= 1u << slot;
+}
+
+template <size_t N>
+uint32_t WideBVH<N>::collapse(const LinearBVH& bvh, uint32_t binary) {
+  const auto& nodes = bvh.nodes();
+
+  // open up the biggest interior child until the node is full
+  std::vector<uint32_t> slots = {binary + 1, nodes[binary].offset};
+  while (slots.size() < N) {
+    int best = -1;
+    for (size_t i = 0; i < slots.size(); ++i) {
+      if (nodes[slots[i]].leaf()) {
+        continue;
+      }
+      if (best < 0 ||
+          surface_area(nodes[slots[i]]) > surface_area(nodes[slots[best]])) {
+        best = i;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    auto opened = slots[best];
+    slots[best] = opened + 1;
+    slots.push_back(nodes[opened].offset);
+  }
+
+  const auto index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+  {
+    auto& node = nodes_[index];
+    std::fill(std::begin(node.min_x), std::end(node.min_x), INFINITY);
+    std::fill(std::begin(node.min_y), std::end(node.min_y), INFINITY);
+    std::fill(std::begin(node.min_z), std::end(node.min_z), INFINITY);
+    std::fill(std::begin(node.max_x), std::end(node.max_x), -INFINITY);
+    std::fill(std::begin(node.max_y), std::end(node.max_y), -INFINITY);
+    std::fill(std::begin(node.max_z), std::end(node.max_z), -INFINITY);
+    std::fill(std::begin(node.child), std::end(node.child), 0);
+    std::fill(std::begin(node.count), std::end(node.count), 0);
+    node.valid = 0;
+  }
+
+  for (size_t i = 0; i < slots.size(); ++i) {
+    const auto& source = nodes[slots[i]];
+    uint32_t child = source.offset;
+    uint16_t count = source.count;
+    if (!source.leaf()) {
+      child = collapse(bvh, slots[i]);  // may reallocate nodes_
+    }
+    auto& node = nodes_[index];
+    set_slot(&node, i, source);
+    node.child[i] = child;
+    node.count[i] = count;
+  }
+  return index;
+}
+
+template <size_t N>
+void WideBVH<N>::refit() {
+  // children always come after their parent, so a reverse sweep sees every
+  // child node before the node itself
+  for (size_t n = nodes_.size(); n-- > 0;) {
+    auto& node = nodes_[n];
+    for (size_t i = 0; i < N; ++i) {
+      if ((node.valid & (1u << i)) == 0) {
+        continue;
+      }
+      float lo[3] = {INFINITY, INFINITY, INFINITY};
+      float hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+      if (node.count[i] > 0) {
+        for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i];
+             ++p) {
+          auto b = primitives_[p]->parent_space_bounds_of();
+          lo[0] = std::min(lo[0], float_round_down(b->min().x));
+          lo[1] = std::min(lo[1], float_round_down(b->min().y));
+          lo[2] = std::min(lo[2], float_round_down(b->min().z));
+          hi[0] = std::max(hi[0], float_round_up(b->max().x));
+          hi[1] = std::max(hi[1], float_round_up(b->max().y));
+          hi[2] = std::max(hi[2], float_round_up(b->max().z));
+        }
+      } else {
+        const auto& c = nodes_[node.child[i]];
+        for (size_t j = 0; j < N; ++j) {
+          if ((c.valid & (1u << j)) == 0) {
+            continue;
+          }
+          lo[0] = std::min(lo[0], c.min_x[j]);
+          lo[1] = std::min(lo[1], c.min_y[j]);
+          lo[2] = std::min(lo[2], c.min_z[j]);
+          hi[0] = std::max(hi[0], c.max_x[j]);
+          hi[1] = std::max(hi[1], c.max_y[j]);
+          hi[2] = std::max(hi[2], c.max_z[j]);
+        }
+      }
+      node.min_x[i] = lo[0];
+      node.min_y[i] = lo[1];
+      node.min_z[i] = lo[2];
+      node.max_x[i] = hi[0];
+      node.max_y[i] = hi[1];
+      node.max_z[i] = hi[2];
+    }
+  }
+}
+
+template <size_t N>
+void WideBVH<N>::intersect(const Ray& r, IntersectionVector* out) const {
+  traverse(r, -INFINITY, INFINITY,
+           [&](uint32_t first, uint32_t count, float* /* tmax */) {
+             for_each_primitive(&primitives_[first], &kinds_[first], count,
+                                [&](auto* p) {
+                                  primitive_intersect_into(p, r, out);
+                                  return false;
+                                });
+             return false;
+           });
+}
+
+template <size_t N>
+IntersectionVector WideBVH<N>::intersect(const Ray& r) const {
+  IntersectionVector out;
+  intersect(r, &out);
+  std::sort(out.begin(), out.end(),
+            [](const auto& a, const auto& b) { return a.t() < b.t(); });
+  return out;
+}
+
+template <size_t N>
+bool WideBVH<N>::occluded(const Ray& r, double tmin, double tmax) const {
+  bool found = false;
+  traverse(r, float_round_down(tmin), float_round_up(tmax),
+           [&](uint32_t first, uint32_t count, float* /* tmax */) {
+             found = for_each_primitive(
+                 &primitives_[first], &kinds_[first], count, [&](auto* p) {
+                   return primitive_occluded(p, r, tmin, tmax);
+                 });
+             return found;
+           });
+  return found;
+}
+
+template <size_t N>
+std::optional<Intersection> WideBVH<N>::closest_hit(const Ray& r, double tmin,
+                                                    double tmax) const {
+  std::optional<Intersection> out;
+  traverse(r, float_round_down(tmin), float_round_up(tmax),
+           [&](uint32_t first, uint32_t count, float* box_tmax) {
+             for_each_primitive(
+                 &primitives_[first], &kinds_[first], count, [&](auto* p) {
+                   auto hit = primitive_closest_hit(p, r, tmin, tmax);
+                   if (hit) {
+                     out = hit;
+                     tmax = hit->t();
+                     *box_tmax = float_round_up(tmax);
+                   }
+                   return false;
+                 });
+             return false;
+           });
+  return out;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "linear_bvh.h"
+
+// Child bounds are stored structure-of-arrays so that a single SSE (N = 4)
+// or AVX (N = 8) operation tests the ray against every child of the node.
+template <size_t N>
+struct alignas(64) WideBVHNode {
+  float min_x[N], min_y[N], min_z[N];
+  float max_x[N], max_y[N], max_z[N];
+  uint32_t child[N];  // node index, or first primitive for leaf children
+  uint16_t count[N];  // primitives in a leaf child, 0 for interior children
+  uint8_t valid;      // bit i is set when slot i is in use
+};
+
+static_assert(sizeof(WideBVHNode<4>) == 128, "BVH4 node must be 128 bytes");
+static_assert(sizeof(WideBVHNode<8>) == 256, "BVH8 node must be 256 bytes");
+
+class WideBVHBase {
+ public:
+  virtual ~WideBVHBase() = default;
+
+  virtual size_t width() const = 0;
+  virtual IntersectionVector intersect(const Ray& r) const = 0;
+  virtual void intersect(const Ray& r, IntersectionVector* out) const = 0;
+  virtual bool occluded(const Ray& r, double tmin, double tmax) const = 0;
+  virtual std::optional<Intersection> closest_hit(const Ray& r, double tmin,
+                                                  double tmax) const = 0;
+  virtual void refit() = 0;
+};
+
+// A 4- or 8-ary BVH collapsed from a binary LinearBVH: each wide node
+// absorbs the binary nodes below it (largest surface area first) until it
+// has N children. Primitives keep the LinearBVH order.
+template <size_t N>
+class WideBVH : public WideBVHBase {
+ public:
+  static_assert(N == 4 || N == 8, "WideBVH supports 4- and 8-wide nodes");
+
+  using Node = WideBVHNode<N>;
+  using NodeVector = std::vector<Node, tbb::cache_aligned_allocator<Node>>;
+
+  explicit WideBVH(const LinearBVH& bvh);
+
+  size_t width() const override { return N; }
+  IntersectionVector intersect(const Ray& r) const override;
+  void intersect(const Ray& r, IntersectionVector* out) const override;
+  bool occluded(const Ray& r, double tmin, double tmax) const override;
+  std::optional<Intersection> closest_hit(const Ray& r, double tmin,
+                                          double tmax) const override;
+  void refit() override;
+
+  const NodeVector& nodes() const { return nodes_; }
+  const std::vector<Shape*>& primitives() const { return primitives_; }
+  const std::vector<PrimitiveKind>& kinds() const { return kinds_; }
+
+  // Returns a mask of the children of `node` that the ray enters within
+  // [tmin, tmax], writing each child's entry distance to `tnear`.
+  static unsigned intersect_children(const Node& node, const LinearBVHRay& r,
+                                     float tmin, float tmax, float* tnear);
+
+  // Same contract as LinearBVH::traverse; leaves are visited in order of
+  // their entry distance.
+  template <typename LeafFn>
+  void traverse(const Ray& r, float tmin, float tmax, LeafFn&& leaf) const;
+
+ private:
+  uint32_t collapse(const LinearBVH& bvh, uint32_t binary);
+  void set_slot(Node* node, size_t slot, const LinearBVHNode& source);
+
+  NodeVector nodes_;
+  std::vector<Shape*> primitives_;
+  std::vector<PrimitiveKind> kinds_;
+};
+
+using WideBVH4 = WideBVH<4>;
+using WideBVH8 = WideBVH<8>;
+
+// The ray's direction signs pick which bound of each axis is the entry
+// plane, so no per-lane min/max is needed. The candidate distance is always
+// the first operand of max/min: the instructions return the second operand
+// when either is NaN, which drops the 0 * inf of a ray lying in a slab
+// plane instead of propagating it.
+template <size_t N>
+unsigned WideBVH<N>::intersect_children(const Node& node,
+                                        const LinearBVHRay& r, float tmin,
+                                        float tmax, float* tnear) {
+  const float* near_x = r.negative[0] ? node.max_x : node.min_x;
+  const float* far_x = r.negative[0] ? node.min_x : node.max_x;
+  const float* near_y = r.negative[1] ? node.max_y : node.min_y;
+  const float* far_y = r.negative[1] ? node.min_y : node.max_y;
+  const float* near_z = r.negative[2] ? node.max_z : node.min_z;
+  const float* far_z = r.negative[2] ? node.min_z : node.max_z;
+  // min planes are measured from origin_up, max planes from origin_down
+  float near_origin[3], far_origin[3];
+  for (int a = 0; a < 3; ++a) {
+    near_origin[a] = r.negative[a] ? r.origin_down[a] : r.origin_up[a];
+    far_origin[a] = r.negative[a] ? r.origin_up[a] : r.origin_down[a];
+  }
+
+#if defined(__AVX__)
+  if constexpr (N == 8) {
+    const auto near_ox = _mm256_set1_ps(near_origin[0]);
+    const auto near_oy = _mm256_set1_ps(near_origin[1]);
+    const auto near_oz = _mm256_set1_ps(near_origin[2]);
+    const auto far_ox = _mm256_set1_ps(far_origin[0]);
+    const auto far_oy = _mm256_set1_ps(far_origin[1]);
+    const auto far_oz = _mm256_set1_ps(far_origin[2]);
+    const auto ix = _mm256_set1_ps(r.inv_direction[0]);
+    const auto iy = _mm256_set1_ps(r.inv_direction[1]);
+    const auto iz = _mm256_set1_ps(r.inv_direction[2]);
+
+    auto near = _mm256_set1_ps(tmin);
+    near = _mm256_max_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_x), near_ox), ix),
+        near);
+    near = _mm256_max_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_y), near_oy), iy),
+        near);
+    near = _mm256_max_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_z), near_oz), iz),
+        near);
+
+    auto far = _mm256_set1_ps(tmax);
+    far = _mm256_min_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_x), far_ox), ix), far);
+    far = _mm256_min_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_y), far_oy), iy), far);
+    far = _mm256_min_ps(
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_z), far_oz), iz), far);
+
+    _mm256_storeu_ps(tnear, near);
+    auto hit = _mm256_cmp_ps(near, far, _CMP_LE_OQ);
+    return static_cast<unsigned>(_mm256_movemask_ps(hit)) & node.valid;
+  }
+#endif
+#if defined(__SSE2__)
+  if constexpr (N == 4) {
+    const auto near_ox = _mm_set1_ps(near_origin[0]);
+    const auto near_oy = _mm_set1_ps(near_origin[1]);
+    const auto near_oz = _mm_set1_ps(near_origin[2]);
+    const auto far_ox = _mm_set1_ps(far_origin[0]);
+    const auto far_oy = _mm_set1_ps(far_origin[1]);
+    const auto far_oz = _mm_set1_ps(far_origin[2]);
+    const auto ix = _mm_set1_ps(r.inv_direction[0]);
+    const auto iy = _mm_set1_ps(r.inv_direction[1]);
+    const auto iz = _mm_set1_ps(r.inv_direction[2]);
+
+    auto near = _mm_set1_ps(tmin);
+    near = _mm_max_ps(
+        _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_x), near_ox), ix), near);
+    near = _mm_max_ps(
+        _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_y), near_oy), iy), near);
+    near = _mm_max_ps(
+        _mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_z), near_oz), iz), near);
+
+    auto far = _mm_set1_ps(tmax);
+    far = _mm_min_ps(
+        _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_x), far_ox), ix), far);
+    far = _mm_min_ps(
+        _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_y), far_oy), iy), far);
+    far = _mm_min_ps(
+        _mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_z), far_oz), iz), far);
+
+    _mm_storeu_ps(tnear, near);
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(near, far))) &
+           node.valid;
+  }
+#endif
+  // portable fallback, e.g. BVH8 without AVX
+  unsigned mask = 0;
+  for (size_t i = 0; i < N; ++i) {
+    float near = tmin;
+    float far = tmax;
+    const float* nears[3] = {near_x, near_y, near_z};
+    const float* fars[3] = {far_x, far_y, far_z};
+    for (int a = 0; a < 3; ++a) {
+      float t0 = (nears[a][i] - near_origin[a]) * r.inv_direction[a];
+      float t1 = (fars[a][i] - far_origin[a]) * r.inv_direction[a];
+      near = t0 > near ? t0 : near;
+      far = t1 < far ? t1 : far;
+    }
+    tnear[i] = near;
+    if (near <= far) {
+      mask |= 1u << i;
+    }
+  }
+  return mask & node.valid;
+}
+
+template <size_t N>
+template <typename LeafFn>
+void WideBVH<N>::traverse(const Ray& r, float tmin, float tmax,
+                          LeafFn&& leaf) const {
+  if (nodes_.empty()) {
+    return;
+  }
+
+  struct Entry {
+    uint32_t child;
+    uint32_t count;
+    float tnear;
+  };
+
+  const LinearBVHRay lr(r);
+  // up to N - 1 deferred children per level
+  folly::small_vector<Entry, BVH_STACK_SIZE / 2 * N> stack;
+  stack.push_back({0, 0, tmin});
+
+  while (!stack.empty()) {
+    const auto entry = stack.back();
+    stack.pop_back();
+    if (entry.tnear > tmax) {
+      continue;  // tmax shrank since this entry was pushed
+    }
+    if (entry.count > 0) {
+      if (leaf(entry.child, entry.count, &tmax)) {
+        return;
+      }
+      continue;
+    }
+
+    const auto& node = nodes_[entry.child];
+    alignas(32) float tnear[N];
+    unsigned mask = intersect_children(node, lr, tmin, tmax, tnear);
+
+    // push far to near so the nearest child is popped first
+    Entry hits[N];
+    size_t n = 0;
+    for (; mask != 0; mask &= mask - 1) {
+      auto i = __builtin_ctz(mask);
+      Entry e{node.child[i], node.count[i], tnear[i]};
+      size_t j = n++;
+      while (j > 0 && hits[j - 1].tnear < e.tnear) {
+        hits[j] = hits[j - 1];
+        --j;
+      }
+      hits[j] = e;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      stack.push_back(hits[i]);
+    }
+  }
+}
@@ -2,10 +2,13 @@
 
 #include <optional>
 
+#include "../shapes/primitive.h"
 #include "../shapes/sphere.h"
+#include "bvh.h"
 #include "intersection.h"
 #include "light.h"
 #include "ray.h"
+#include "ray_packet.h"
 
 class World {
  public:
@@ -32,14 +35,19 @@ class World {
 
   Color shade_hit(const ComputedIntersection& comps, int remaining = 5) {
     auto intensity = light_->intensity_at(comps.over_point, this);
+    return shade_hit(comps, remaining, intensity);
+  }
 
-    auto surface = comps.object->material()->lighting(
+  // As above, with the light's visibility at comps.over_point already known.
+  Color shade_hit(const ComputedIntersection& comps, int remaining,
+                  double intensity) {
+    auto surface = comps.material->lighting(
         comps.object, light_, comps.over_point, comps.eyev, comps.normalv,
         intensity);
 
     auto reflected = reflected_color(comps, remaining);
     auto refracted = refracted_color(comps, remaining);
-    auto material = comps.object->material();
+    auto material = comps.material;
 
     if (material->reflective() > 0 && material->transparency() > 0) {
       auto ref = comps.schlick();
@@ -49,21 +57,117 @@ class World {
   }
 
   Color color_at(const Ray& r, int remaining = 5) {
-    auto intersections = intersect(r);
-    auto hit = Hit(intersections);
+    auto hit = closest_hit(r);
     if (hit) {
-      auto comps = ComputedIntersection(*hit, r);
-      return shade_hit(comps, remaining);
+      return shade_hit(computations(*hit, r), remaining);
     }
 
     return Color(0, 0, 0);
   }
 
+  // Only refraction needs the full, sorted intersection list: n1 and n2
+  // come from walking the containers the ray passes through up to the hit.
+  // The list goes into a per-thread buffer that is reused from ray to ray.
+  ComputedIntersection computations(const Intersection& hit, const Ray& r) {
+    if (hit.object()->material_at(hit)->transparency() > 0) {
+      static thread_local IntersectionVector xs;
+      intersect(r, &xs);
+      return ComputedIntersection(hit, r, xs);
+    }
+    return ComputedIntersection(hit, r);
+  }
+
+  // Shades up to N coherent rays (e.g. neighbouring camera rays) as a
+  // packet; out[i] matches color_at(rays[i]). Point-light shadow rays are
+  // traced as a second packet. Reflection and refraction stay per-ray.
+  template <size_t N>
+  void color_at(const Ray* rays, size_t count, Color* out, int remaining = 5) {
+    assert(count <= N);
+    std::optional<Intersection> hits[N];
+    closest_hit<N>(rays, count, hits);
+
+    std::optional<ComputedIntersection> comps[N];
+    for (size_t i = 0; i < count; ++i) {
+      if (hits[i]) {
+        comps[i].emplace(computations(*hits[i], rays[i]));
+      }
+    }
+
+    double intensity[N];
+    auto point_light = dynamic_cast<PointLight*>(light_);
+    if (point_light != nullptr) {
+      // pack the lanes that hit something into a shadow packet
+      std::optional<Ray> shadow[N];
+      double distance[N];
+      size_t lane[N];
+      size_t n = 0;
+      for (size_t i = 0; i < count; ++i) {
+        if (comps[i]) {
+          auto v = point_light->position() - comps[i]->over_point;
+          distance[n] = v.magnitude();
+          shadow[n] = Ray(comps[i]->over_point, v.normalize());
+          lane[n++] = i;
+        }
+      }
+      auto blocked = occluded<N>(shadow, distance, n);
+      for (size_t j = 0; j < n; ++j) {
+        intensity[lane[j]] = (blocked & (1u << j)) ? 0.0 : 1.0;
+      }
+    } else {
+      for (size_t i = 0; i < count; ++i) {
+        if (comps[i]) {
+          intensity[i] = light_->intensity_at(comps[i]->over_point, this);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = comps[i] ? shade_hit(*comps[i], remaining, intensity[i])
+                        : Color(0, 0, 0);
+    }
+  }
+
   Shape* get_object(int index) { return objects_[index]; }
 
   int size() const { return objects_.size(); }
 
-  void add(Shape* s) { objects_.push_back(s); };
+  void add(Shape* s) {
+    clear_bvh();
+    objects_.push_back(s);
+  };
+
+  // Caches every object's world-space matrices and bounds (see
+  // Shape::commit()), after which tracing only reads the scene and may run
+  // on many threads. Call once the scene, and any BVH over it, is complete.
+  void commit() {
+    for_each_root([](Shape* o) {
+      o->commit();
+      return true;
+    });
+  }
+
+  // True if nothing has moved or changed since the last commit().
+  bool committed() const {
+    bool out = true;
+    for_each_root([&out](Shape* o) {
+      out = o->committed();
+      return out;
+    });
+    return out;
+  }
+
+  // Builds a top-level BVH over the world's objects (usually Instances and
+  // already-built Groups). Invalidated by add().
+  BVHStats build_bvh(const BVHBuildOptions& options = {}) {
+    clear_bvh();
+    top_ = std::make_shared<Group>();
+    for (const auto& o : objects_) {
+      top_->add(o);
+    }
+    auto stats = BVHBuilder(options).build(top_.get());
+    top_->build_linear_bvh();
+    return stats;
+  }
 
   bool contains(const Shape& s) const {
     for (const auto& i : objects_) {
@@ -80,46 +184,158 @@ class World {
 
   IntersectionVector intersect(const Ray& r) const {
     IntersectionVector out;
-    out.reserve(objects_.size() * 3);
+    intersect(r, &out);
+    return out;
+  }
 
-    for (auto& o : objects_) {
-      auto hits = o->intersects(r);
-      std::move(std::begin(hits), std::end(hits), std::back_inserter(out));
-    }
+  // Fills `out` with the sorted intersections, reusing its storage.
+  void intersect(const Ray& r, IntersectionVector* out) const {
+    out->clear();
+    for_each_root([&](Shape* o) {
+      o->intersect_into(r, out);
+      return true;
+    });
 
-    std::sort(out.begin(), out.end(),
+    std::sort(out->begin(), out->end(),
               [](const Intersection& a, const Intersection& b) {
                 return a.t() < b.t();
               });
+  }
+
+  // Packet version of intersect(): out[i] matches intersect(rays[i]).
+  template <size_t N>
+  void intersect(const Ray* rays, size_t count, IntersectionVector* out) const {
+    assert(count <= N);
+    std::optional<Ray> lanes[N];
+    double tmin[N], tmax[N];
+    unsigned mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+      lanes[i] = rays[i];
+      tmin[i] = -INFINITY;
+      tmax[i] = INFINITY;
+      mask |= 1u << i;
+      out[i].clear();
+    }
+
+    auto collect = [&](size_t lane, auto* s, const Ray& r) {
+      primitive_intersect_into(s, r, &out[lane]);
+      return false;
+    };
+    for_each_root([&](Shape* o) {
+      trace_packet<N>(o, lanes, mask, tmin, tmax, collect);
+      return true;
+    });
+
+    for (size_t i = 0; i < count; ++i) {
+      std::sort(out[i].begin(), out[i].end(),
+                [](const Intersection& a, const Intersection& b) {
+                  return a.t() < b.t();
+                });
+    }
+  }
+
+  // Returns a mask of the lanes whose ray hits something in
+  // [0, distances[i]). Lanes drop out of the packet as soon as they do.
+  template <size_t N>
+  unsigned occluded(const std::optional<Ray>* rays, const double* distances,
+                    size_t count) const {
+    assert(count <= N);
+    double tmin[N], tmax[N];
+    unsigned mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+      tmin[i] = 0.0;
+      tmax[i] = distances[i];
+      mask |= 1u << i;
+    }
+
+    auto blocks = [&](size_t lane, auto* s, const Ray& r) {
+      return primitive_occluded(s, r, 0.0, distances[lane]);
+    };
+    unsigned open = mask;
+    for_each_root([&](Shape* o) {
+      open = trace_packet<N>(o, rays, open, tmin, tmax, blocks);
+      return open != 0;
+    });
+    return mask & ~open;
+  }
+
+  // Closest-hit query: the nearest intersection with t in [tmin, tmax), as
+  // Hit(intersect(r)) would return it, found without building the list.
+  std::optional<Intersection> closest_hit(const Ray& r, double tmin = 0.0,
+                                          double tmax = INFINITY) const {
+    std::optional<Intersection> out;
+    for_each_root([&](Shape* o) {
+      auto hit = o->closest_hit(r, tmin, tmax);
+      if (hit) {
+        out = hit;
+        tmax = hit->t();
+      }
+      return true;
+    });
     return out;
   }
 
+  // Packet version of closest_hit() over [0, inf).
+  template <size_t N>
+  void closest_hit(const Ray* rays, size_t count,
+                   std::optional<Intersection>* out) const {
+    assert(count <= N);
+    std::optional<Ray> lanes[N];
+    double tmin[N], tmax[N];
+    unsigned mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+      lanes[i] = rays[i];
+      tmin[i] = 0.0;
+      tmax[i] = INFINITY;
+      mask |= 1u << i;
+      out[i].reset();
+    }
+
+    auto nearest = [&](size_t lane, auto* s, const Ray& r) {
+      auto hit = primitive_closest_hit(s, r, tmin[lane], tmax[lane]);
+      if (hit) {
+        out[lane] = hit;
+        tmax[lane] = hit->t();
+      }
+      return false;
+    };
+    for_each_root([&](Shape* o) {
+      trace_packet<N>(o, lanes, mask, tmin, tmax, nearest);
+      return true;
+    });
+  }
+
+  // Any-hit query: true if something lies along the ray in [0, tmax).
+  // Returns at the first such intersection, without collecting or sorting.
+  bool occluded(const Ray& r, double tmax) const {
+    bool found = false;
+    for_each_root([&](Shape* o) {
+      found = o->occluded(r, 0.0, tmax);
+      return !found;
+    });
+    return found;
+  }
+
   bool is_shadowed(const Tuple& light_position, const Tuple& point) const {
     auto v = light_position - point;
     auto distance = v.magnitude();
-    auto direction = v.normalize();
-
-    auto r = Ray(point, direction);
-    auto intersections = intersect(r);
-
-    auto h = Hit(intersections);
-    return h && h->t() < distance;
+    return occluded(Ray(point, v.normalize()), distance);
   }
 
   Color reflected_color(const ComputedIntersection& comps, int remaining = 5) {
     if (remaining <= 0) {
       return Color(0, 0, 0);
     }
-    if (comps.object->material()->reflective() < EPSILON) {
+    if (comps.material->reflective() < EPSILON) {
       return Color(0, 0, 0);
     }
     auto reflect_ray = Ray(comps.over_point, comps.reflectv);
     auto color = color_at(reflect_ray, --remaining);
-    return color * comps.object->material()->reflective();
+    return color * comps.material->reflective();
   }
 
   Color refracted_color(const ComputedIntersection& comps, int remaining = 5) {
-    if (comps.object->material()->transparency() == 0) {
+    if (comps.material->transparency() == 0) {
       return Color(0, 0, 0);
     }
     if (remaining == 0) {
@@ -138,10 +354,92 @@ class World {
     auto refract_ray = Ray(comps.under_point, direction);
 
     return color_at(refract_ray, remaining - 1) *
-           comps.object->material()->transparency();
+           comps.material->transparency();
   }
 
  private:
+  // Calls fn(object) for each top-level object (or the world BVH) until it
+  // returns false.
+  template <typename Fn>
+  void for_each_root(Fn&& fn) const {
+    if (top_) {
+      fn(top_.get());
+      return;
+    }
+    for (const auto& o : objects_) {
+      if (!fn(o)) {
+        return;
+      }
+    }
+  }
+
+  // Calls fn(lane, primitive, ray) for each lane in `lanes` whose ray may
+  // hit a primitive below `shape`, with the ray in the primitive's parent
+  // space; a true return finishes the lane, and fn may shrink tmax[lane].
+  // Groups with a LinearBVH are traversed as a packet, everything else one
+  // ray at a time. Ray::transform keeps t, so the [tmin, tmax] ranges apply
+  // at every level. Returns the lanes that are still unfinished.
+  //
+  // S is the shape's static type: a concrete primitive type when the BVH
+  // leaf tagged it (see for_each_primitive()), so fn's calls bind
+  // statically and no group check is needed.
+  template <size_t N, typename S, typename Fn>
+  unsigned trace_packet(S* shape, const std::optional<Ray>* rays,
+                        unsigned lanes, const double* tmin, double* tmax,
+                        Fn& fn) const {
+    Group* group = nullptr;
+    if constexpr (std::is_same_v<S, Shape>) {
+      group = dynamic_cast<Group*>(shape);
+    }
+    auto bvh = group == nullptr ? nullptr : group->linear_bvh();
+    if (bvh == nullptr) {
+      for (unsigned m = lanes; m != 0; m &= m - 1) {
+        auto lane = __builtin_ctz(m);
+        if (fn(lane, shape, *rays[lane])) {
+          lanes &= ~(1u << lane);
+        }
+      }
+      return lanes;
+    }
+
+    const auto inverse = group->inverse();
+    std::optional<Ray> local[N];
+    RayPacket<N> packet;
+    for (unsigned m = lanes; m != 0; m &= m - 1) {
+      auto lane = __builtin_ctz(m);
+      local[lane] = rays[lane]->transform(inverse);
+      packet.set(lane, *local[lane], tmin[lane], tmax[lane]);
+    }
+
+    const auto& primitives = bvh->primitives();
+    const auto& kinds = bvh->kinds();
+    bvh->traverse(&packet, [&](uint32_t first, uint32_t count, unsigned mask) {
+      for_each_primitive(
+          &primitives[first], &kinds[first], count, [&](auto* p) {
+            auto done = mask & ~trace_packet<N>(p, local, mask, tmin, tmax, fn);
+            packet.active &= ~done;
+            mask &= ~done;
+            return mask == 0;
+          });
+      for (unsigned m = mask; m != 0; m &= m - 1) {
+        auto lane = __builtin_ctz(m);
+        packet.tmax[lane] = float_round_up(tmax[lane]);
+      }
+    });
+    return packet.active;
+  }
+
+  void clear_bvh() {
+    if (!top_) {
+      return;
+    }
+    for (const auto& o : top_->release_primitives()) {
+      o->set_parent(nullptr);
+    }
+    top_.reset();
+  }
+
   std::vector<Shape*> objects_;
   Light* light_;
+  std::shared_ptr<Group> top_;
 };
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "../shapes/group.h"
 #include "../shapes/shape.h"
 #include "../shapes/triangle.h"
+#include "../shapes/triangle_mesh.h"
 #include "folly/Conv.h"
 #include "folly/String.h"
 #include "file.h"
@@ -45,7 +46,10 @@ FaceVertex parse_face(const std::string& f) {
 
 class ObjFile : public File {
  public:
-  explicit ObjFile(const std::string& blob, bool normalize = false)
+  // With `mesh` set the faces go into a single TriangleMesh rather than
+  // one Triangle or SmoothTriangle shape each.
+  explicit ObjFile(const std::string& blob, bool normalize = false,
+                   bool mesh = false)
       : File(blob, normalize),
         ignored_{},
         vertices_{Tuple::point(0, 0, 0)},
@@ -140,21 +144,10 @@ class ObjFile : public File {
       }
     }
 
-    for (const auto& f : faces_) {
-      if (f[0].n_index == -1) {
-        auto t = std::make_unique<Triangle>(vertices_[f[0].v_index],
-                                                 vertices_[f[1].v_index],
-                                                 vertices_[f[2].v_index]);
-        default_group_->add(t.get());
-        owned_shapes_.push_back(std::move(t));
-        continue;
-      }
-      auto t = std::make_unique<SmoothTriangle>(vertices_[f[0].v_index], vertices_[f[1].v_index],
-                             vertices_[f[2].v_index], normals_[f[0].n_index],
-                             normals_[f[1].n_index], normals_[f[2].n_index]);
-      default_group_->add(t.get());
-      owned_shapes_.push_back(std::move(t));
-      continue;
+    if (mesh) {
+      build_mesh();
+    } else {
+      build_triangles();
     }
     std::cout << "Done parsing: " << vertices_.size() << " points, "
               << normals_.size() << " normals, " << faces_.size() << " faces, "
@@ -180,6 +173,46 @@ class ObjFile : public File {
   std::shared_ptr<Group> default_group() { return default_group_; }
 
  private:
+  void build_triangles() {
+    for (const auto& f : faces_) {
+      if (f[0].n_index == -1) {
+        auto t = std::make_unique<Triangle>(vertices_[f[0].v_index],
+                                                 vertices_[f[1].v_index],
+                                                 vertices_[f[2].v_index]);
+        default_group_->add(t.get());
+        owned_shapes_.push_back(std::move(t));
+        continue;
+      }
+      auto t = std::make_unique<SmoothTriangle>(vertices_[f[0].v_index], vertices_[f[1].v_index],
+                             vertices_[f[2].v_index], normals_[f[0].n_index],
+                             normals_[f[1].n_index], normals_[f[2].n_index]);
+      default_group_->add(t.get());
+      owned_shapes_.push_back(std::move(t));
+      continue;
+    }
+  }
+
+  void build_mesh() {
+    auto m = std::make_unique<TriangleMesh>();
+    for (const auto& v : vertices_) {
+      m->add_vertex(v);
+    }
+    for (const auto& n : normals_) {
+      m->add_normal(n);
+    }
+    for (const auto& f : faces_) {
+      if (f[0].n_index == -1) {
+        m->add_triangle(f[0].v_index, f[1].v_index, f[2].v_index);
+        continue;
+      }
+      m->add_triangle(f[0].v_index, f[1].v_index, f[2].v_index,
+                      f[0].n_index, f[1].n_index, f[2].n_index);
+    }
+    m->build();
+    default_group_->add(m.get());
+    owned_shapes_.push_back(std::move(m));
+  }
+
   uint32_t ignored_;
   std::vector<Tuple> vertices_;
   std::vector<Tuple> normals_;
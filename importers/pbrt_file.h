@@ -116,7 +116,8 @@ class PBRTFile : public File {
       }
       if (shape) {
         shape->set_transform(array_to_matrix(s->shapeToWorld.start));
-        default_group_->add(shape);
+        default_group_->add(shape.get());
+        shapes_.push_back(std::move(shape));
       }
     }
   }
@@ -128,6 +129,7 @@ class PBRTFile : public File {
  protected:
   PointLight* light_;
   Camera* camera_;
+  std::vector<std::shared_ptr<Shape>> shapes_;
 };
 
 #endif  // RAY_TRACING2_PBRT_FILE_H
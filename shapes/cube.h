@@ -10,7 +10,7 @@
 class Cube : public Shape {
  public:
   bool compare(const Shape&) const noexcept override { return true; }
-  IntersectionVector local_intersect(const Ray& r) override {
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override {
     auto [ytmin, ytmax] = check_axis(r.origin().y, r.direction().y);
     auto [ztmin, ztmax] = check_axis(r.origin().z, r.direction().z);
     auto [xtmin, xtmax] = check_axis(r.origin().x, r.direction().x);
@@ -19,11 +19,45 @@ class Cube : public Shape {
     auto tmax = std::min({xtmax, ytmax, ztmax});
 
     if (tmin > tmax) {
-      return {};
+      return;
     }
-    return { Intersection(tmin, this), Intersection(tmax, this)};
+    out->push_back(Intersection(tmin, this));
+    out->push_back(Intersection(tmax, this));
   };
 
+  bool local_occluded(const Ray& r, double tmin, double tmax) override {
+    auto [ytmin, ytmax] = check_axis(r.origin().y, r.direction().y);
+    auto [ztmin, ztmax] = check_axis(r.origin().z, r.direction().z);
+    auto [xtmin, xtmax] = check_axis(r.origin().x, r.direction().x);
+
+    auto t0 = std::max({xtmin, ytmin, ztmin});
+    auto t1 = std::min({xtmax, ytmax, ztmax});
+    if (t0 > t1) {
+      return false;
+    }
+    return (t0 >= tmin && t0 < tmax) || (t1 >= tmin && t1 < tmax);
+  }
+
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override {
+    auto [ytmin, ytmax] = check_axis(r.origin().y, r.direction().y);
+    auto [ztmin, ztmax] = check_axis(r.origin().z, r.direction().z);
+    auto [xtmin, xtmax] = check_axis(r.origin().x, r.direction().x);
+
+    auto t0 = std::max({xtmin, ytmin, ztmin});
+    auto t1 = std::min({xtmax, ytmax, ztmax});
+    if (t0 > t1) {
+      return {};
+    }
+    if (t0 >= tmin && t0 < tmax) {
+      return Intersection(t0, this);
+    }
+    if (t1 >= tmin && t1 < tmax) {
+      return Intersection(t1, this);
+    }
+    return {};
+  }
+
   Tuple local_normal_at(const Tuple& p, const Intersection* i) override {
     auto maxc = std::max({abs(p.x), abs(p.y), abs(p.z)});
     if (maxc == abs(p.x)) {
@@ -3,6 +3,11 @@
 //
 
 #pragma once
+#include <algorithm>
+#include <stdexcept>
+
+#include "../core/linear_bvh.h"
+#include "../core/wide_bvh.h"
 #include "shape.h"
 
 using ShapeVector = std::vector<Shape*>;
@@ -11,26 +16,62 @@ class Group : public Shape {
  public:
   bool compare(const Shape&) const noexcept override { return true; }
 
-  IntersectionVector local_intersect(const Ray& r) override {
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override {
     if (!bounds_of()->intersects(r)) {
-      return {};
+      return;
     }
 
-    IntersectionVector out;
-    out.reserve(2 * children_.size());
+    if (wide_) {
+      return wide_->intersect(r, out);
+    }
+    if (linear_) {
+      return linear_->intersect(r, out);
+    }
 
     for (const auto& i : children_) {
-      auto result = i->intersects(r);
-      for (const auto& j : result) {
-        out.push_back(j);
-      }
+      i->intersect_into(r, out);
     }
+  };
 
-    std::sort(out.begin(), out.end(),
-              [](const auto& a, const auto& b) { return a.t() < b.t(); });
+  bool local_occluded(const Ray& r, double tmin, double tmax) override {
+    if (!bounds_of()->intersects(r)) {
+      return false;
+    }
+    if (wide_) {
+      return wide_->occluded(r, tmin, tmax);
+    }
+    if (linear_) {
+      return linear_->occluded(r, tmin, tmax);
+    }
+    for (const auto& c : children_) {
+      if (c->occluded(r, tmin, tmax)) {
+        return true;
+      }
+    }
+    return false;
+  }
 
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override {
+    if (!bounds_of()->intersects(r)) {
+      return {};
+    }
+    if (wide_) {
+      return wide_->closest_hit(r, tmin, tmax);
+    }
+    if (linear_) {
+      return linear_->closest_hit(r, tmin, tmax);
+    }
+    std::optional<Intersection> out;
+    for (const auto& c : children_) {
+      auto hit = c->closest_hit(r, tmin, tmax);
+      if (hit) {
+        out = hit;
+        tmax = hit->t();
+      }
+    }
     return out;
-  };
+  }
 
   Tuple local_normal_at(const Tuple& p, const Intersection* i) override {
     return Tuple::vector(0, 0, 0);
@@ -51,7 +92,7 @@ class Group : public Shape {
   void add(T* s) {
     s->set_parent(this);
     children_.push_back(s);
-    updated_ = true;
+    children_changed();
 
     //    // need to fix parent in shape's children
     //    if constexpr (std::is_same_v<T, Group>) {
@@ -70,6 +111,45 @@ class Group : public Shape {
     return true;
   }
 
+  void bake_transform(const Matrix& m) override {
+    auto full = m * transform();
+    for (const auto& c : children_) {
+      c->bake_transform(full);
+    }
+    set_transform(Matrix(IDENTITY));
+    children_changed();
+  }
+
+  // Bakes every group transform below (and including) this one into the
+  // leaves, so that a ray is transformed once per primitive rather than
+  // once per level, and normals skip the walk up the parents. Identity
+  // groups are then folded into the LinearBVH node array. Drops any BVHs
+  // built inside the hierarchy; run it before building them.
+  void flatten() { bake_transform(Matrix(IDENTITY)); }
+
+  // Children first, so that this group's bounds are built from their
+  // committed parent-space boxes.
+  void commit() override {
+    for (const auto& c : children_) {
+      c->commit();
+    }
+    bounds_of(/* use_cache */ false);
+    Shape::commit();
+  }
+
+  bool committed() const override {
+    return Shape::committed() &&
+           std::all_of(children_.begin(), children_.end(),
+                       [](const Shape* c) { return c->committed(); });
+  }
+
+  void uncommit() override {
+    Shape::uncommit();
+    for (const auto& c : children_) {
+      c->uncommit();
+    }
+  }
+
   template <typename T>
   T* child(size_t idx) {
     return (T*)children_[idx];
@@ -79,8 +159,10 @@ class Group : public Shape {
 
   BoundingBox* bounds_of() override { return bounds_of(true); }
 
+  // Rebuilds the box from the children when it is stale, unless the group
+  // is committed: commit() left it final, and rendering must not write.
   BoundingBox* bounds_of(bool use_cache) {
-    if (updated_ || !use_cache) {
+    if (!use_cache || (updated_ && !Shape::committed())) {
       BoundingBox new_box;
       for (const auto& c : children_) {
         auto cbox = c->parent_space_bounds_of();
@@ -100,7 +182,7 @@ class Group : public Shape {
     auto [left, right] = bounds->split();
 
     ShapeVector::iterator it;
-    updated_ = true;
+    children_changed();
 
     for (it = children_.begin(); it != children_.end(); /* no increment */) {
       auto child_bounds = (*it)->parent_space_bounds_of();
@@ -121,15 +203,95 @@ class Group : public Shape {
     return {out_left, out_right};
   }
 
-  void make_subgroup(const ShapeVector& shapes) {
-    auto g = new Group();  // TODO: leaks!
+  Group* make_subgroup(const ShapeVector& shapes) {
+    auto g = std::make_shared<Group>();
     for (const auto& s : shapes) {
       g->add(s);
     }
-    add(g);
+    add(g.get());
+    subgroups_.push_back(g);
     updated_ = true;
+    return g.get();
+  }
+
+  // Detaches all children (keeping any subgroups this group owns alive) so
+  // that a builder can redistribute them into a new hierarchy.
+  ShapeVector release_children() {
+    ShapeVector out;
+    std::swap(out, children_);
+    children_changed();
+    return out;
+  }
+
+  // Detaches every primitive below this group, dissolving the subgroups
+  // created by make_subgroup() (i.e. acceleration nodes) along the way.
+  ShapeVector release_primitives() {
+    ShapeVector out;
+    for (const auto& c : release_children()) {
+      auto it = std::find_if(
+          subgroups_.begin(), subgroups_.end(),
+          [&c](const auto& g) { return g.get() == c; });
+      if (it == subgroups_.end()) {
+        out.push_back(c);
+        continue;
+      }
+      for (const auto& p : (*it)->release_primitives()) {
+        out.push_back(p);
+      }
+    }
+    subgroups_.clear();
+    return out;
+  }
+
+  // Recomputes the cached bounds bottom-up after children have been
+  // transformed, keeping the hierarchy as it is.
+  void refit() {
+    for (const auto& c : children_) {
+      auto g = dynamic_cast<Group*>(c);
+      if (g != nullptr) {
+        g->refit();
+      }
+    }
+    bounds_of(/* use_cache */ false);
+    invalidate_commit();
+    if (linear_) {
+      linear_->refit();
+    }
+    if (wide_) {
+      wide_->refit();
+    }
+  }
+
+  // Flattens this group's (already divided) hierarchy into a LinearBVH that
+  // is used for intersections until the children change.
+  const LinearBVH* build_linear_bvh() {
+    linear_ = std::make_shared<LinearBVH>(this);
+    return linear_.get();
   }
 
+  const LinearBVH* linear_bvh() const { return linear_.get(); }
+
+  // Collapses the LinearBVH (built first if needed) into a 4- or 8-wide BVH
+  // whose nodes are tested with one SIMD operation. A width of 2 keeps the
+  // binary LinearBVH.
+  const WideBVHBase* build_wide_bvh(size_t width) {
+    if (!linear_) {
+      build_linear_bvh();
+    }
+    if (width == 4) {
+      wide_ = std::make_shared<WideBVH4>(*linear_);
+    } else if (width == 8) {
+      wide_ = std::make_shared<WideBVH8>(*linear_);
+    } else if (width == 2) {
+      wide_.reset();
+    } else {
+      throw std::runtime_error("BVH width must be 2, 4 or 8");
+    }
+    return wide_.get();
+  }
+
+  const WideBVHBase* wide_bvh() const { return wide_.get(); }
+
   void divide(const size_t threshold) override {
     if (threshold <= children_.size()) {
       auto [left, right] = partition_children();
@@ -147,7 +309,18 @@ class Group : public Shape {
   }
 
  private:
+  // Drops the cached bounds, any BVH, and every commit.
+  void children_changed() {
+    updated_ = true;
+    linear_.reset();
+    wide_.reset();
+    invalidate_commit();
+  }
+
   BoundingBox box_;
   bool updated_ = true;
   ShapeVector children_ = {};
+  std::vector<std::shared_ptr<Group>> subgroups_ = {};
+  std::shared_ptr<LinearBVH> linear_;
+  std::shared_ptr<WideBVHBase> wide_;
 };
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "group.h"
+
+// A placement of a shared prototype (typically a mesh Group with its own
+// BVH) under a transform of its own. Any number of instances can reference
+// the same prototype, so memory scales with unique geometry rather than
+// with the number of placements. The prototype must not itself be added to
+// the world, and must not contain instances.
+class Instance : public Shape {
+ public:
+  explicit Instance(std::shared_ptr<Group> prototype)
+      : Shape(), prototype_(std::move(prototype)) {
+    if (prototype_->linear_bvh() == nullptr) {
+      prototype_->build_linear_bvh();
+    }
+    box_ = *prototype_->parent_space_bounds_of();
+  }
+
+  bool compare(const Shape& other) const noexcept override {
+    return prototype_ == static_cast<const Instance&>(other).prototype_;
+  }
+
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override {
+    auto begin = out->size();
+    prototype_->intersect_into(r, out);
+    for (auto i = begin; i < out->size(); ++i) {
+      (*out)[i].set_instance(this);
+    }
+  }
+
+  bool local_occluded(const Ray& r, double tmin, double tmax) override {
+    return prototype_->occluded(r, tmin, tmax);
+  }
+
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override {
+    auto hit = prototype_->closest_hit(r, tmin, tmax);
+    if (hit) {
+      hit->set_instance(this);
+    }
+    return hit;
+  }
+
+  // Shading goes through the prototype's primitive (see world_normal_at).
+  Tuple local_normal_at(const Tuple& p, const Intersection* i) override {
+    return Tuple::vector(0, 0, 0);
+  }
+
+  BoundingBox* bounds_of() override { return &box_; }
+
+  // Call after the shared prototype has been modified.
+  void refit() {
+    box_ = *prototype_->parent_space_bounds_of();
+    invalidate_commit();
+  }
+
+  // The prototype has no parent: its matrices stop at the prototype, and
+  // world_normal_at() applies the instance's on top. Instances sharing it
+  // commit it once.
+  void commit() override {
+    if (!prototype_->Shape::committed()) {
+      prototype_->commit();
+    }
+    Shape::commit();
+  }
+
+  // A change to the prototype uncommits only the prototype. It holds no
+  // instances, so its own flag covers everything below it.
+  bool committed() const override {
+    return Shape::committed() && prototype_->Shape::committed();
+  }
+
+  Group* prototype() const { return prototype_.get(); }
+
+ private:
+  std::shared_ptr<Group> prototype_;
+};
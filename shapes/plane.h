@@ -8,16 +8,34 @@
 class Plane : public Shape {
  public:
   bool compare(const Shape&) const noexcept override { return true; }
-  IntersectionVector local_intersect(const Ray& r) override {
-    IntersectionVector out;
-
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override {
     if (abs(r.direction().y) < EPSILON) {
-      return out;
+      return;
     }
     auto t = -r.origin().y / r.direction().y;
-    return {Intersection(t, this)};
+    out->push_back(Intersection(t, this));
   };
 
+  bool local_occluded(const Ray& r, double tmin, double tmax) override {
+    if (abs(r.direction().y) < EPSILON) {
+      return false;
+    }
+    auto t = -r.origin().y / r.direction().y;
+    return t >= tmin && t < tmax;
+  }
+
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override {
+    if (abs(r.direction().y) < EPSILON) {
+      return {};
+    }
+    auto t = -r.origin().y / r.direction().y;
+    if (t >= tmin && t < tmax) {
+      return Intersection(t, this);
+    }
+    return {};
+  }
+
   Tuple local_normal_at(const Tuple& p, const Intersection* i) override {
     return Tuple::vector(0, 1, 0);
   }
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <typeinfo>
+
+#include "cube.h"
+#include "plane.h"
+#include "shape.h"
+#include "sphere.h"
+#include "triangle.h"
+
+// The concrete type of a BVH primitive, recorded when the BVH is built so
+// that traversal can call the shape's intersection code directly instead
+// of through the vtable. Only exact types are tagged (a subclass of Sphere
+// is OTHER), so a tag never skips an override.
+enum class PrimitiveKind : uint8_t {
+  OTHER,  // anything else, groups included: dispatched virtually
+  SPHERE,
+  CUBE,
+  PLANE,
+  TRIANGLE,
+  SMOOTH_TRIANGLE,
+};
+
+inline PrimitiveKind primitive_kind(const Shape* s) {
+  const auto& type = typeid(*s);
+  if (type == typeid(Sphere)) {
+    return PrimitiveKind::SPHERE;
+  }
+  if (type == typeid(Cube)) {
+    return PrimitiveKind::CUBE;
+  }
+  if (type == typeid(Plane)) {
+    return PrimitiveKind::PLANE;
+  }
+  if (type == typeid(Triangle)) {
+    return PrimitiveKind::TRIANGLE;
+  }
+  if (type == typeid(SmoothTriangle)) {
+    return PrimitiveKind::SMOOTH_TRIANGLE;
+  }
+  return PrimitiveKind::OTHER;
+}
+
+// Shape::intersect_into(), occluded() and closest_hit() for a primitive of
+// static type S. For a concrete S the local_* call is qualified, so it is
+// bound (and usually inlined) at compile time; S = Shape falls back to the
+// virtual call.
+template <typename S>
+void primitive_intersect_into(S* s, const Ray& r, IntersectionVector* out) {
+  if constexpr (std::is_same_v<S, Shape>) {
+    s->intersect_into(r, out);
+  } else {
+    s->S::local_intersect_into(r.transform(s->inverse()), out);
+  }
+}
+
+template <typename S>
+bool primitive_occluded(S* s, const Ray& r, double tmin, double tmax) {
+  if constexpr (std::is_same_v<S, Shape>) {
+    return s->occluded(r, tmin, tmax);
+  } else {
+    return s->S::local_occluded(r.transform(s->inverse()), tmin, tmax);
+  }
+}
+
+template <typename S>
+std::optional<Intersection> primitive_closest_hit(S* s, const Ray& r,
+                                                  double tmin, double tmax) {
+  if constexpr (std::is_same_v<S, Shape>) {
+    return s->closest_hit(r, tmin, tmax);
+  } else {
+    return s->S::local_closest_hit(r.transform(s->inverse()), tmin, tmax);
+  }
+}
+
+namespace detail {
+template <typename S, typename Fn>
+bool for_each_as(Shape* const* shapes, uint32_t count, Fn& fn) {
+  for (uint32_t i = 0; i < count; ++i) {
+    if (fn(static_cast<S*>(shapes[i]))) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace detail
+
+// Calls fn(p) for each of the count shapes, with p cast to the concrete
+// type its kind names (Shape* for OTHER), until fn returns true. BVH leaves
+// keep equal kinds together, so the switch runs once per run of equal
+// kinds and each run is a plain loop over one statically known callee.
+// Returns true if fn stopped the walk.
+template <typename Fn>
+bool for_each_primitive(Shape* const* shapes, const PrimitiveKind* kinds,
+                        uint32_t count, Fn&& fn) {
+  uint32_t begin = 0;
+  while (begin < count) {
+    const auto kind = kinds[begin];
+    auto end = begin + 1;
+    while (end < count && kinds[end] == kind) {
+      ++end;
+    }
+    auto run = shapes + begin;
+    auto n = end - begin;
+    bool stop;
+    switch (kind) {
+      case PrimitiveKind::SPHERE:
+        stop = detail::for_each_as<Sphere>(run, n, fn);
+        break;
+      case PrimitiveKind::CUBE:
+        stop = detail::for_each_as<Cube>(run, n, fn);
+        break;
+      case PrimitiveKind::PLANE:
+        stop = detail::for_each_as<Plane>(run, n, fn);
+        break;
+      case PrimitiveKind::TRIANGLE:
+        stop = detail::for_each_as<Triangle>(run, n, fn);
+        break;
+      case PrimitiveKind::SMOOTH_TRIANGLE:
+        stop = detail::for_each_as<SmoothTriangle>(run, n, fn);
+        break;
+      default:
+        stop = detail::for_each_as<Shape>(run, n, fn);
+        break;
+    }
+    if (stop) {
+      return true;
+    }
+    begin = end;
+  }
+  return false;
+}
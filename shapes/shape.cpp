@@ -13,12 +13,27 @@ bool Shape::operator!=(const Shape &other) const noexcept {
   return !(*this == other);
 }
 
+void Shape::invalidate_commit(bool moved) {
+  if (moved) {
+    uncommit();
+  }
+  committed_ = false;
+  // an uncommitted shape's ancestors are uncommitted already
+  for (auto p = parent_; p != nullptr && p->committed_; p = p->parent_) {
+    p->committed_ = false;
+  }
+}
+
 Tuple Shape::worldToObject(const Tuple &point) {
+  if (committed()) {
+    return world_to_object_ * point;
+  }
+
   Tuple p = point;
   if (parent_ != nullptr) {
     p = parent_->worldToObject(p);
   }
-  return this->transform().inverse() * p;
+  return inverse_ * p;
 };
 
 std::optional<Intersection> Hit(const IntersectionVector &v) {
@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <optional>
+
+#include "../core/affine_transform.h"
 #include "../core/bounding_box.h"
 #include "../core/intersection.h"
 #include "../core/material.h"
@@ -17,9 +21,7 @@
 class Shape : public std::enable_shared_from_this<Shape> {
  public:
   explicit Shape()
-      : transform_(Matrix(IDENTITY)),
-        inverse_(Matrix(IDENTITY)),
-        material_(Material()),
+      : material_(Material()),
         parent_{nullptr} {}
 
   virtual ~Shape() = default;
@@ -29,19 +31,75 @@ class Shape : public std::enable_shared_from_this<Shape> {
 
   virtual bool compare(const Shape &) const noexcept = 0;
 
-  Matrix transform() { return transform_; }
-  Matrix inverse() { return inverse_; }
+  Matrix transform() const { return transform_.matrix(); }
+  const AffineTransform& inverse() const { return inverse_; }
 
   Shape* parent() { return parent_; }
-  void set_parent(Shape* p) { parent_ = p; }
+  void set_parent(Shape* p) {
+    parent_ = p;
+    invalidate_commit(/* moved */ true);
+  }
 
   void set_transform(const Matrix &t) {
-    transform_ = t;
+    transform_ = AffineTransform(t);
     inverse_ = transform_.inverse();
+    invalidate_commit(/* moved */ true);
+  }
+
+  // Caches the world-to-object, object-to-world and normal matrices and the
+  // parent-space bounds of this shape (groups commit their children first
+  // and then finalize their own bounds), so that normal_at() does no matrix
+  // inversion or parent-chain walk and no query writes to the shape: a
+  // committed scene can be traced from any number of threads. A later
+  // set_transform(), set_parent() or change of geometry uncommits the shape
+  // and its ancestors, and a move also everything below it, but nothing
+  // outside that hierarchy; until the next commit the uncommitted shapes
+  // recompute on use, which is only safe from a single thread.
+  virtual void commit() {
+    world_to_object_ = world_to_object();
+    object_to_world_ = object_to_world();
+    normal_to_world_ = world_to_object_.linear_transpose();
+    parent_box_ = bounds_of()->transform(transform_);
+    committed_ = true;
+  }
+
+  // A committed group or instance is committed all the way down: a group
+  // asks its children and an instance its prototype, which nothing below
+  // the instance would otherwise uncommit. That visits every shape, so the
+  // tracing paths test only the shape's own commit.
+  virtual bool committed() const { return committed_; }
+
+  // Drops the commit of this shape and of everything below it.
+  virtual void uncommit() { committed_ = false; }
+
+  // Replaces this shape's transform with m * transform(). Shapes that can
+  // push the result further down do so and end up with an identity
+  // transform: groups into their children, triangles and meshes into their
+  // vertices. Used by Group::flatten().
+  virtual void bake_transform(const Matrix &m) { set_transform(m * transform()); }
+
+  AffineTransform world_to_object() const {
+    if (committed_) {
+      return world_to_object_;
+    }
+    return parent_ == nullptr ? inverse_
+                              : inverse_ * parent_->world_to_object();
+  }
+
+  AffineTransform object_to_world() const {
+    if (committed_) {
+      return object_to_world_;
+    }
+    return parent_ == nullptr ? transform_
+                              : parent_->object_to_world() * transform_;
   }
 
   Material *material() { return &material_; }
 
+  // The material at a hit on this shape. Shapes made of many primitives
+  // that each carry their own (SphereSet) override it.
+  virtual Material *material_at(const Intersection &hit) { return &material_; }
+
   void set_material(const Material &m) { material_ = m; }
 
   IntersectionVector intersects(const Ray &r) {
@@ -49,6 +107,27 @@ class Shape : public std::enable_shared_from_this<Shape> {
     return local_intersect(local_ray);
   };
 
+  // Appends the intersections to `out` (unsorted). Callers keep `out`
+  // around between rays so that its storage is reused rather than
+  // reallocated.
+  void intersect_into(const Ray &r, IntersectionVector *out) {
+    local_intersect_into(r.transform(inverse_), out);
+  }
+
+  // True if the ray hits the shape at some t in [tmin, tmax). Meant for
+  // shadow rays: shapes override local_occluded() to answer without
+  // building (or sorting) an intersection list.
+  bool occluded(const Ray &r, double tmin, double tmax) {
+    return local_occluded(r.transform(inverse_), tmin, tmax);
+  }
+
+  // The nearest intersection with t in [tmin, tmax), if any. Callers pass
+  // the best t found so far as tmax so that farther geometry is skipped.
+  std::optional<Intersection> closest_hit(const Ray &r, double tmin,
+                                          double tmax) {
+    return local_closest_hit(r.transform(inverse_), tmin, tmax);
+  }
+
   Tuple normal_at(const Tuple &p, const Intersection* i = nullptr) {
     auto local_point = worldToObject(p);
     auto local_normal = local_normal_at(local_point, i);
@@ -57,7 +136,9 @@ class Shape : public std::enable_shared_from_this<Shape> {
   }
 
   BoundingBox* parent_space_bounds_of() {
-    parent_box_ = bounds_of()->transform(transform_);
+    if (!committed_) {
+      parent_box_ = bounds_of()->transform(transform_);
+    }
     return &parent_box_;
   }
 
@@ -66,13 +147,48 @@ class Shape : public std::enable_shared_from_this<Shape> {
 
   virtual BoundingBox* bounds_of() { return &box_; }
 
-  virtual IntersectionVector local_intersect(const Ray &r) = 0;
+  // Shapes override at least one of these two; each defaults to the other.
+  virtual IntersectionVector local_intersect(const Ray &r) {
+    IntersectionVector out;
+    local_intersect_into(r, &out);
+    std::sort(out.begin(), out.end(),
+              [](const auto &a, const auto &b) { return a.t() < b.t(); });
+    return out;
+  }
+  virtual void local_intersect_into(const Ray &r, IntersectionVector *out) {
+    for (const auto &i : local_intersect(r)) {
+      out->push_back(i);
+    }
+  }
+  virtual bool local_occluded(const Ray &r, double tmin, double tmax) {
+    for (const auto &i : local_intersect(r)) {
+      if (i.t() >= tmin && i.t() < tmax) {
+        return true;
+      }
+    }
+    return false;
+  }
+  virtual std::optional<Intersection> local_closest_hit(const Ray &r,
+                                                        double tmin,
+                                                        double tmax) {
+    std::optional<Intersection> out;
+    for (const auto &i : local_intersect(r)) {
+      if (i.t() >= tmin && i.t() < tmax) {
+        out = i;
+        tmax = i.t();
+      }
+    }
+    return out;
+  }
   virtual Tuple local_normal_at(const Tuple &p, const Intersection* i) = 0;
   Tuple worldToObject(const Tuple &point);
   Tuple normalToWorld(const Tuple &normalVector) {
-    Tuple world_normal = this->inverse_.transpose() * normalVector;
-    world_normal.w = 0;
-    world_normal = world_normal.normalize();
+    if (committed_) {
+      return (normal_to_world_ * Vec3(normalVector)).normalize();
+    }
+
+    Tuple world_normal =
+        (inverse_.linear_transpose() * Vec3(normalVector)).normalize();
 
     if (parent_ != nullptr) {
       world_normal = parent_->normalToWorld(world_normal);
@@ -83,14 +199,23 @@ class Shape : public std::enable_shared_from_this<Shape> {
   virtual void divide(const size_t threshold) {}
 
  protected:
+  // Called by anything that changes a shape's bounds, or with `moved` its
+  // transform or parent, which the caches below it are built from.
+  void invalidate_commit(bool moved = false);
+
   BoundingBox box_;
   BoundingBox parent_box_;
-  Matrix transform_;
-  Matrix inverse_;
+  AffineTransform transform_;
+  AffineTransform inverse_;
   Material material_;
   Shape* parent_;
 
  private:
+  AffineTransform world_to_object_;
+  AffineTransform object_to_world_;
+  AffineTransform normal_to_world_;
+  bool committed_ = false;
+
   Tuple objectToWorld(const Tuple &point) { return this->transform_ * point; };
 
 };
@@ -118,14 +243,27 @@ private:
     Ray saved_ray_;
 };
 
+// Instanced primitives are shared between placements, so their parent chain
+// stops at the prototype; the instance supplies the rest of the transform.
+inline Tuple world_normal_at(const Intersection &hit, const Tuple &point) {
+  auto instance = hit.instance();
+  if (instance == nullptr) {
+    return hit.object()->normal_at(point, &hit);
+  }
+  auto local_normal =
+      hit.object()->normal_at(instance->worldToObject(point), &hit);
+  return instance->normalToWorld(local_normal);
+}
+
 struct ComputedIntersection {
   ComputedIntersection(const Intersection& hit, const Ray& r,
                        const IntersectionVector& xs = {})
       : object(hit.object()),
+        material(object->material_at(hit)),
         t(hit.t()),
         point(r.position(t)),
         eyev(-r.direction()),
-        normalv(object->normal_at(point, &hit)),
+        normalv(world_normal_at(hit, point)),
         over_point(Tuple::point(0, 0, 0)),
         under_point(Tuple::point(0, 0, 0)),
         reflectv(Tuple::vector(0, 0, 0)),
@@ -136,36 +274,31 @@ struct ComputedIntersection {
       inside = true;
       normalv = -normalv;
     }
-    reflectv = r.direction().reflect(normalv);
+    reflectv = r.direction().reflect(Vec3(normalv));
     over_point = point + normalv * EPSILON;
     under_point = point - normalv * EPSILON;
 
-    std::vector<Shape*> containers;
+    // the entering intersection of each container, for its material
+    std::vector<const Intersection *> containers;
+    auto refractive = [&containers]() {
+      auto c = containers.back();
+      return c->object()->material_at(*c)->refractive();
+    };
     for (const auto &i : xs) {
       if (i == hit) {
-        if (containers.empty()) {
-          this->n1 = 1.0;
-        } else {
-          this->n1 =
-              containers[containers.size() - 1]->material()->refractive();
-        }
+        this->n1 = containers.empty() ? 1.0 : refractive();
       }
-      auto it =
-          std::find_if(std::begin(containers), std::end(containers),
-                       [&i](const auto &c) { return c == i.object(); });
+      auto it = std::find_if(
+          std::begin(containers), std::end(containers),
+          [&i](const auto &c) { return c->same_surface(i); });
       if (it != containers.end()) {
         containers.erase(it);
       } else {
-        containers.push_back(i.object());
+        containers.push_back(&i);
       }
 
       if (i == hit) {
-        if (containers.empty()) {
-          this->n2 = 1.0;
-        } else {
-          this->n2 =
-              containers[containers.size() - 1]->material()->refractive();
-        }
+        this->n2 = containers.empty() ? 1.0 : refractive();
         break;
       }
     }
@@ -191,6 +324,7 @@ struct ComputedIntersection {
   }
 
   Shape* object;
+  Material* material;
   double t;
   Tuple point;
   Tuple eyev;
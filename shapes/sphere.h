@@ -21,29 +21,40 @@ class Sphere : public Shape {
 
   explicit Sphere() : Shape() {}
 
-  // FIXME: this can be optimized a fair bit
-  IntersectionVector local_intersect(const Ray &r) override {
-    auto sphere_to_ray = r.origin() - Tuple::point(0, 0, 0);
-    auto a = dot(r.direction(), r.direction());
-    auto b = 2 * dot(r.direction(), sphere_to_ray);
-    auto c = dot(sphere_to_ray, sphere_to_ray) - 1;
-    auto d = b * b - 4 * a * c;
+  void local_intersect_into(const Ray &r, IntersectionVector *out) override {
+    double t0, t1;
+    if (!roots(r, &t0, &t1)) {
+      return;
+    }
+    out->push_back(Intersection(t0, this));
+    out->push_back(Intersection(t1, this));
+  }
 
-    if (d < 0) {
-      return IntersectionVector();
+  bool local_occluded(const Ray &r, double tmin, double tmax) override {
+    double t0, t1;
+    if (!roots(r, &t0, &t1)) {
+      return false;
     }
+    return (t0 >= tmin && t0 < tmax) || (t1 >= tmin && t1 < tmax);
+  }
 
-    IntersectionVector out{
-        Intersection((-b - sqrt(d)) / (2 * a), this),
-        Intersection((-b + sqrt(d)) / (2 * a), this),
-    };
-    return out;
+  std::optional<Intersection> local_closest_hit(const Ray &r, double tmin,
+                                                double tmax) override {
+    double t0, t1;
+    if (!roots(r, &t0, &t1)) {
+      return {};
+    }
+    if (t0 >= tmin && t0 < tmax) {
+      return Intersection(t0, this);
+    }
+    if (t1 >= tmin && t1 < tmax) {
+      return Intersection(t1, this);
+    }
+    return {};
   }
 
   Tuple local_normal_at(const Tuple &p, const Intersection* i) override {
-    auto normal = p - Tuple::point(0, 0, 0);
-    // normal.w = 0;
-    return normal;
+    return Tuple::vector(p.x, p.y, p.z);
   }
 
   BoundingBox* bounds_of() override {
@@ -53,6 +64,24 @@ class Sphere : public Shape {
   bool compare(const Shape &) const noexcept override { return true; }
 
  private:
+  // Both distances at which the ray meets the unit sphere, nearest first.
+  // Uses the half-b form of the quadratic, which saves a multiply per term.
+  static bool roots(const Ray &r, double *t0, double *t1) {
+    const Vec3 sphere_to_ray = r.origin() - Point3(0, 0, 0);
+    const Vec3 &d = r.direction();
+    auto a = dot(d, d);
+    auto half_b = dot(d, sphere_to_ray);
+    auto c = dot(sphere_to_ray, sphere_to_ray) - 1;
+    auto disc = half_b * half_b - a * c;
+    if (disc < 0) {
+      return false;
+    }
+    auto root = sqrt(disc);
+    *t0 = (-half_b - root) / a;
+    *t1 = (-half_b + root) / a;
+    return true;
+  }
+
   BoundingBox box_ = { Tuple::point(-1, -1, -1), Tuple::point(1, 1, 1) };
 };
 
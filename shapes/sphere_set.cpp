@@ -0,0 +1,316 @@
+#include "sphere_set.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../core/simd.h"
+
+namespace {
+template <typename T, typename A>
+size_t bytes_of(const std::vector<T, A>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+// The float kernel only has to avoid dropping a hit that the Real test
+// would keep, so its bounds are widened by this much (relative).
+constexpr float KERNEL_SLACK = 1e-5f;
+
+using BlockFloat = SimdFloat<SPHERE_BLOCK_WIDTH>;
+
+struct BlockRay {
+  explicit BlockRay(const Ray& r) {
+    auto o = r.origin();
+    auto d = r.direction();
+    origin[0] = BlockFloat::broadcast(o.x);
+    origin[1] = BlockFloat::broadcast(o.y);
+    origin[2] = BlockFloat::broadcast(o.z);
+    direction[0] = BlockFloat::broadcast(d.x);
+    direction[1] = BlockFloat::broadcast(d.y);
+    direction[2] = BlockFloat::broadcast(d.z);
+    inv_a = BlockFloat::broadcast(1.0f / static_cast<float>(dot(d, d)));
+    // rounding the origin and the centers to float moves the difference by
+    // up to this much
+    auto reach = std::max({std::abs(o.x), std::abs(o.y), std::abs(o.z)});
+    slack = BlockFloat::broadcast(KERNEL_SLACK * (1 + 2 * reach));
+  }
+
+  BlockFloat origin[3];
+  BlockFloat direction[3];
+  BlockFloat inv_a;
+  BlockFloat slack;
+};
+
+BlockFloat dot(const BlockFloat* a, const BlockFloat* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Returns the lanes of the block whose sphere the ray may meet at some t in
+// [tmin, tmax]. Instead of b^2 - ac, which cancels badly in float for small
+// spheres far from the origin, the discriminant is taken from the ray's
+// closest approach to each center.
+unsigned intersect_block(const SphereBlock& block, const BlockRay& r,
+                         float tmin, float tmax) {
+  BlockFloat center_to_ray[3];
+  for (int a = 0; a < 3; ++a) {
+    center_to_ray[a] = r.origin[a] - BlockFloat::load(block.center[a]);
+  }
+  const auto zero = BlockFloat::broadcast(0.0f);
+  auto t_closest = zero - dot(r.direction, center_to_ray) * r.inv_a;
+  BlockFloat closest[3];
+  for (int a = 0; a < 3; ++a) {
+    closest[a] = center_to_ray[a] + r.direction[a] * t_closest;
+  }
+
+  auto radius = BlockFloat::load(block.radius) + r.slack +
+                BlockFloat::broadcast(KERNEL_SLACK) *
+                    sqrt(dot(center_to_ray, center_to_ray));
+  auto half_chord2 = radius * radius - dot(closest, closest);
+  unsigned mask = half_chord2 >= zero;
+  mask &= (1u << block.count) - 1;
+  if (mask == 0) {
+    return 0;
+  }
+
+  // the half chord in units of t, so the roots are t_closest -/+ half_chord
+  auto half_chord = sqrt(max(half_chord2, zero) * r.inv_a);
+  auto slack = KERNEL_SLACK * (1 + std::max(std::abs(tmin), std::abs(tmax)));
+  mask &= (t_closest + half_chord >= BlockFloat::broadcast(tmin - slack)) &
+          (t_closest - half_chord <= BlockFloat::broadcast(tmax + slack));
+  return mask;
+}
+}  // namespace
+
+uint32_t SphereSet::add_material(const Material& m) {
+  materials_.push_back(m);
+  return materials_.size() - 1;
+}
+
+uint32_t SphereSet::add_sphere(const Tuple& center, double radius,
+                               uint32_t material) {
+  if (material != NO_MATERIAL && material >= materials_.size()) {
+    throw std::runtime_error("sphere material index out of range");
+  }
+  if (!(radius > 0)) {
+    throw std::runtime_error("sphere radius must be positive");
+  }
+  x_.push_back(center.x);
+  y_.push_back(center.y);
+  z_.push_back(center.z);
+  radius_.push_back(radius);
+  material_indices_.push_back(material);
+
+  auto s = static_cast<uint32_t>(x_.size() - 1);
+  auto r = Tuple::vector(radius_[s], radius_[s], radius_[s]);
+  box_.add(this->center(s) - r);
+  box_.add(this->center(s) + r);
+  nodes_.clear();
+  blocks_.clear();
+  invalidate_commit();
+  return s;
+}
+
+void SphereSet::build(size_t leaf_size) {
+  nodes_.clear();
+  blocks_.clear();
+  leaf_size_ = leaf_size;
+  if (sphere_count() == 0) {
+    return;
+  }
+
+  std::vector<LinearBVH::BuildRef> refs(sphere_count());
+  for (uint32_t i = 0; i < refs.size(); ++i) {
+    auto r = Tuple::vector(radius_[i], radius_[i], radius_[i]);
+    refs[i].index = i;
+    refs[i].bounds.add(center(i) - r);
+    refs[i].bounds.add(center(i) + r);
+    refs[i].centroid = center(i);
+  }
+  nodes_ = LinearBVH::build_nodes(&refs, leaf_size);
+
+  // lay the spheres out in leaf order
+  auto reorder = [&refs](auto* v) {
+    std::remove_reference_t<decltype(*v)> out(v->size());
+    for (size_t i = 0; i < refs.size(); ++i) {
+      out[i] = (*v)[refs[i].index];
+    }
+    *v = std::move(out);
+  };
+  reorder(&x_);
+  reorder(&y_);
+  reorder(&z_);
+  reorder(&radius_);
+  reorder(&material_indices_);
+
+  build_blocks();
+}
+
+void SphereSet::bake_transform(const Matrix& m) {
+  const auto full = m * transform();
+  const auto x = full * Tuple::vector(1, 0, 0);
+  const auto y = full * Tuple::vector(0, 1, 0);
+  const auto z = full * Tuple::vector(0, 0, 1);
+  const auto scale = x.magnitude();
+  const bool round =
+      std::abs(y.magnitude() - scale) < EPSILON &&
+      std::abs(z.magnitude() - scale) < EPSILON &&
+      std::abs(dot(x, y)) < EPSILON && std::abs(dot(y, z)) < EPSILON &&
+      std::abs(dot(z, x)) < EPSILON;
+  if (!round) {
+    set_transform(full);
+    return;
+  }
+
+  box_ = BoundingBox();
+  for (uint32_t i = 0; i < sphere_count(); ++i) {
+    auto c = full * center(i);
+    x_[i] = c.x;
+    y_[i] = c.y;
+    z_[i] = c.z;
+    radius_[i] *= scale;
+    auto r = Tuple::vector(radius_[i], radius_[i], radius_[i]);
+    box_.add(center(i) - r);
+    box_.add(center(i) + r);
+  }
+  set_transform(Matrix(IDENTITY));
+  if (!nodes_.empty()) {
+    build(leaf_size_);
+  }
+}
+
+// Repoints every leaf from its sphere range to the blocks packing it.
+void SphereSet::build_blocks() {
+  blocks_.clear();
+  for (auto& node : nodes_) {
+    if (!node.leaf()) {
+      continue;
+    }
+    const auto first_block = static_cast<uint32_t>(blocks_.size());
+    for (uint32_t first = node.offset; first < node.offset + node.count;
+         first += SPHERE_BLOCK_WIDTH) {
+      SphereBlock block{};
+      block.first = first;
+      block.count = std::min<uint32_t>(SPHERE_BLOCK_WIDTH,
+                                       node.offset + node.count - first);
+      for (uint32_t lane = 0; lane < block.count; ++lane) {
+        block.center[0][lane] = x_[first + lane];
+        block.center[1][lane] = y_[first + lane];
+        block.center[2][lane] = z_[first + lane];
+        block.radius[lane] = radius_[first + lane];
+      }
+      blocks_.push_back(block);
+    }
+    node.count = blocks_.size() - first_block;
+    node.offset = first_block;
+  }
+}
+
+size_t SphereSet::memory_bytes() const {
+  return bytes_of(x_) + bytes_of(y_) + bytes_of(z_) + bytes_of(radius_) +
+         bytes_of(material_indices_) + bytes_of(materials_) +
+         bytes_of(nodes_) + bytes_of(blocks_);
+}
+
+bool SphereSet::roots(uint32_t s, const Ray& r, double* t0,
+                      double* t1) const {
+  const Vec3 sphere_to_ray = r.origin() - Point3(x_[s], y_[s], z_[s]);
+  const Vec3& d = r.direction();
+  const Real radius = radius_[s];
+  auto a = dot(d, d);
+  auto half_b = dot(d, sphere_to_ray);
+  auto c = dot(sphere_to_ray, sphere_to_ray) - radius * radius;
+  auto disc = half_b * half_b - a * c;
+  if (disc < 0) {
+    return false;
+  }
+  auto root = sqrt(disc);
+  *t0 = (-half_b - root) / a;
+  *t1 = (-half_b + root) / a;
+  return true;
+}
+
+template <typename Fn>
+void SphereSet::for_each_candidate(const Ray& r, double tmin, double tmax,
+                                   Fn&& fn) const {
+  if (nodes_.empty()) {
+    float box_tmax = float_round_up(tmax);
+    for (uint32_t i = 0; i < sphere_count(); ++i) {
+      if (fn(i, &box_tmax)) {
+        return;
+      }
+    }
+    return;
+  }
+  const BlockRay block_ray(r);
+  const float block_tmin = float_round_down(tmin);
+  LinearBVH::traverse(
+      nodes_, r, block_tmin, float_round_up(tmax),
+      [&](uint32_t first, uint32_t count, float* box_tmax) {
+        for (uint32_t b = first; b < first + count; ++b) {
+          const auto& block = blocks_[b];
+          auto mask = intersect_block(block, block_ray, block_tmin, *box_tmax);
+          for (; mask != 0; mask &= mask - 1) {
+            if (fn(block.first + __builtin_ctz(mask), box_tmax)) {
+              return true;
+            }
+          }
+        }
+        return false;
+      });
+}
+
+void SphereSet::local_intersect_into(const Ray& r, IntersectionVector* out) {
+  for_each_candidate(r, -INFINITY, INFINITY, [&](uint32_t s, float*) {
+    double t0, t1;
+    if (roots(s, r, &t0, &t1)) {
+      out->push_back(Intersection(t0, this, 0, 0, s));
+      out->push_back(Intersection(t1, this, 0, 0, s));
+    }
+    return false;
+  });
+}
+
+bool SphereSet::local_occluded(const Ray& r, double tmin, double tmax) {
+  bool found = false;
+  for_each_candidate(r, tmin, tmax, [&](uint32_t s, float*) {
+    double t0, t1;
+    found = roots(s, r, &t0, &t1) &&
+            ((t0 >= tmin && t0 < tmax) || (t1 >= tmin && t1 < tmax));
+    return found;
+  });
+  return found;
+}
+
+std::optional<Intersection> SphereSet::local_closest_hit(const Ray& r,
+                                                         double tmin,
+                                                         double tmax) {
+  std::optional<Intersection> out;
+  for_each_candidate(r, tmin, tmax, [&](uint32_t s, float* box_tmax) {
+    double t0, t1;
+    if (!roots(s, r, &t0, &t1)) {
+      return false;
+    }
+    for (auto t : {t0, t1}) {
+      if (t >= tmin && t < tmax) {
+        out = Intersection(t, this, 0, 0, s);
+        tmax = t;
+        *box_tmax = float_round_up(tmax);
+        break;
+      }
+    }
+    return false;
+  });
+  return out;
+}
+
+Tuple SphereSet::local_normal_at(const Tuple& p, const Intersection* i) {
+  if (i == nullptr) {
+    throw std::runtime_error("a sphere set normal needs the hit sphere");
+  }
+  uint32_t s = i->index();
+  return (p - center(s)) / radius_[s];
+}
+
+Material* SphereSet::material_at(const Intersection& hit) {
+  auto m = material_indices_[hit.index()];
+  return m == NO_MATERIAL ? &material_ : &materials_[m];
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "../core/linear_bvh.h"
+#include "shape.h"
+
+// Spheres per SIMD block, as for TriangleBlock.
+#if defined(__AVX__)
+static constexpr size_t SPHERE_BLOCK_WIDTH = 8;
+#else
+static constexpr size_t SPHERE_BLOCK_WIDTH = 4;
+#endif
+
+// Up to SPHERE_BLOCK_WIDTH consecutive spheres of one BVH leaf in
+// structure-of-arrays form, so one ray is tested against all of them at
+// once. Lanes past `count` are masked off.
+struct alignas(32) SphereBlock {
+  float center[3][SPHERE_BLOCK_WIDTH];
+  float radius[SPHERE_BLOCK_WIDTH];
+  uint32_t first;  // sphere in lane 0
+  uint32_t count;
+};
+
+using SphereBlockVector =
+    std::vector<SphereBlock, tbb::cache_aligned_allocator<SphereBlock>>;
+
+// Many spheres sharing one transform, for particle scenes. Each sphere is a
+// center, a radius and a material index in float and index arrays, about
+// 20 bytes where a Sphere is a whole Shape with its matrices and Material.
+// The set keeps its own BVH whose leaves address spheres by index; hits
+// report the sphere through Intersection::index().
+//
+// Each leaf's spheres are also packed into SphereBlocks. A leaf is tested
+// with a float SIMD kernel that rejects most spheres at once; the lanes it
+// keeps are re-tested one by one with the same Real math as Sphere.
+//
+// A sphere is shaded with the material it was added with, or the set's own
+// material() for NO_MATERIAL.
+class SphereSet : public Shape {
+ public:
+  static constexpr uint32_t NO_MATERIAL = UINT32_MAX;
+
+  bool compare(const Shape&) const noexcept override { return true; }
+
+  uint32_t add_material(const Material& m);
+  uint32_t add_sphere(const Tuple& center, double radius,
+                      uint32_t material = NO_MATERIAL);
+
+  // Builds the sphere BVH (binned SAH, at most leaf_size spheres per leaf)
+  // and its blocks. Spheres are reordered so that every leaf is a
+  // contiguous range. Until this is called every ray is tested against
+  // every sphere.
+  void build(size_t leaf_size = SPHERE_BLOCK_WIDTH);
+
+  size_t sphere_count() const { return x_.size(); }
+  Tuple center(uint32_t i) const { return Tuple::point(x_[i], y_[i], z_[i]); }
+  double radius(uint32_t i) const { return radius_[i]; }
+
+  // Leaves of nodes() hold a range of blocks() rather than of spheres.
+  const LinearBVHNodeVector& nodes() const { return nodes_; }
+  const SphereBlockVector& blocks() const { return blocks_; }
+
+  // Bytes held by the sphere and BVH buffers.
+  size_t memory_bytes() const;
+
+  size_t size(bool recurse = false) const override { return sphere_count(); }
+
+  // Moves the spheres into the parent's space when m * transform() keeps
+  // them round (rotation, uniform scale and translation), rebuilding the
+  // BVH if there was one. Any other transform stays on the set.
+  void bake_transform(const Matrix& m) override;
+
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override;
+  bool local_occluded(const Ray& r, double tmin, double tmax) override;
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override;
+
+  // Needs the hit to know which sphere it is on; throws
+  // std::runtime_error without one.
+  Tuple local_normal_at(const Tuple& p, const Intersection* i) override;
+
+  Material* material_at(const Intersection& hit) override;
+
+ private:
+  // Both distances at which the ray meets sphere `s`, as in Sphere::roots().
+  bool roots(uint32_t s, const Ray& r, double* t0, double* t1) const;
+
+  // Calls fn(sphere, &tmax) for every sphere the ray may hit within
+  // [tmin, tmax]; fn may shrink tmax and returns true to stop.
+  template <typename Fn>
+  void for_each_candidate(const Ray& r, double tmin, double tmax, Fn&& fn) const;
+
+  void build_blocks();
+
+  std::vector<float> x_, y_, z_, radius_;
+  std::vector<uint32_t> material_indices_;
+  std::vector<Material> materials_;
+  LinearBVHNodeVector nodes_;
+  SphereBlockVector blocks_;
+  size_t leaf_size_ = SPHERE_BLOCK_WIDTH;
+};
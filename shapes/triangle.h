@@ -9,43 +9,78 @@
 
 class Triangle : public Shape {
  public:
-  Triangle(const Tuple& p1, const Tuple& p2, const Tuple& p3)
-      : Shape(),
-        p1{p1},
-        p2{p2},
-        p3{p3},
-        e1{p2 - p1},
-        e2{p3 - p1},
-        normal{cross(e2, e1).normalize()} {
+  Triangle(const Tuple& p1, const Tuple& p2, const Tuple& p3) : Shape() {
+    set_points(p1, p2, p3);
+  }
+
+  void set_points(const Tuple& a, const Tuple& b, const Tuple& c) {
+    p1 = Point3(a);
+    p2 = Point3(b);
+    p3 = Point3(c);
+    e1 = p2 - p1;
+    e2 = p3 - p1;
+    normal = cross(e2, e1).normalize();
+    box_ = BoundingBox();
     box_.add(p1);
     box_.add(p2);
     box_.add(p3);
+    invalidate_commit();
+  }
+
+  // Moves the vertices into the parent's space instead of transforming rays.
+  void bake_transform(const Matrix& m) override {
+    auto full = m * transform();
+    set_points(full * p1, full * p2, full * p3);
+    set_transform(Matrix(IDENTITY));
   }
 
   bool compare(const Shape&) const noexcept override { return true; }
 
-  IntersectionVector local_intersect(const Ray& r) override  {
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override {
+    double t, u, v;
+    if (hit(r, &t, &u, &v)) {
+      out->push_back(Intersection(t, this));
+    }
+  };
+
+  bool local_occluded(const Ray& r, double tmin, double tmax) override {
+    double t, u, v;
+    return hit(r, &t, &u, &v) && t >= tmin && t < tmax;
+  }
+
+  // Carries u, v for SmoothTriangle's normal interpolation.
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override {
+    double t, u, v;
+    if (hit(r, &t, &u, &v) && t >= tmin && t < tmax) {
+      return Intersection(t, this, u, v);
+    }
+    return {};
+  }
+
+  // Moller-Trumbore; fills in the distance and barycentric u, v on a hit.
+  bool hit(const Ray& r, double* t, double* u, double* v) const {
     auto dir_cross_e2 = cross(r.direction(), e2);
     auto det = dot(e1, dir_cross_e2);
     if (abs(det) < EPSILON) {
-      return {};
+      return false;
     }
     auto f = 1.0 / det;
     auto p1_to_origin = r.origin() - p1;
-    auto u = f * dot(p1_to_origin, dir_cross_e2);
-    if (u < 0 || u > 1) {
-      return {};
+    *u = f * dot(p1_to_origin, dir_cross_e2);
+    if (*u < 0 || *u > 1) {
+      return false;
     }
 
     auto origin_cross_e1 = cross(p1_to_origin, e1);
-    auto v = f * dot(r.direction(), origin_cross_e1);
-    if (v < 0 || (u + v) > 1) {
-      return {};
+    *v = f * dot(r.direction(), origin_cross_e1);
+    if (*v < 0 || (*u + *v) > 1) {
+      return false;
     }
 
-    auto t = f * dot(e2, origin_cross_e1);
-    return { Intersection(t, this) };
-  };
+    *t = f * dot(e2, origin_cross_e1);
+    return true;
+  }
 
   Tuple local_normal_at(const Tuple& p, const Intersection* i) override { return normal; }
 
@@ -53,14 +88,14 @@ class Triangle : public Shape {
     return &box_;
   }
 
-  Tuple p1, p2, p3;
-  Tuple e1, e2, normal;
+  Point3 p1, p2, p3;
+  Vec3 e1, e2, normal;
   BoundingBox box_;
 };
 
 class SmoothTriangle : public Triangle {
  public:
-  SmoothTriangle(const Tuple& p1, const Tuple& p2, const Tuple& p3, const Tuple& n1, const Tuple& n2, const Tuple& n3) : Triangle(p1, p2, p3), n1{n1}, n2{n2}, n3{n3} {
+  SmoothTriangle(const Tuple& p1, const Tuple& p2, const Tuple& p3, const Tuple& n1, const Tuple& n2, const Tuple& n3) : Triangle(p1, p2, p3), n1(n1), n2(n2), n3(n3) {
 
   }
 
@@ -68,28 +103,22 @@ class SmoothTriangle : public Triangle {
     return n2 * i->u + n3 * i->v + n1 * (1 - i->u - i->v);
   }
 
-  IntersectionVector local_intersect(const Ray& r) override {
-    auto dir_cross_e2 = cross(r.direction(), e2);
-    auto det = dot(e1, dir_cross_e2);
-    if (abs(det) < EPSILON) {
-      return {};
-    }
-    auto f = 1.0 / det;
-    auto p1_to_origin = r.origin() - p1;
-    auto u = f * dot(p1_to_origin, dir_cross_e2);
-    if (u < 0 || u > 1) {
-      return {};
-    }
-
-    auto origin_cross_e1 = cross(p1_to_origin, e1);
-    auto v = f * dot(r.direction(), origin_cross_e1);
-    if (v < 0 || (u + v) > 1) {
-      return {};
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override {
+    double t, u, v;
+    if (hit(r, &t, &u, &v)) {
+      out->push_back(Intersection(t, this, u, v));
     }
+  }
 
-    auto t = f * dot(e2, origin_cross_e1);
-    return { Intersection(t, this, u, v) };
+  // The vertex normals are mapped but not renormalized: interpolation is
+  // linear, so the shading normals keep their direction exactly.
+  void bake_transform(const Matrix& m) override {
+    auto normals = (m * transform()).inverse().transpose();
+    n1 = normals * n1;
+    n2 = normals * n2;
+    n3 = normals * n3;
+    Triangle::bake_transform(m);
   }
 
-  Tuple n1, n2, n3;
+  Vec3 n1, n2, n3;
 };
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../core/simd.h"
+
+namespace {
+template <typename T, typename A>
+size_t bytes_of(const std::vector<T, A>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+// The float kernel only has to avoid dropping a hit that the Real test
+// would keep, so its bounds are widened by this much (relative).
+constexpr float KERNEL_SLACK = 1e-5f;
+
+using BlockFloat = SimdFloat<TRIANGLE_BLOCK_WIDTH>;
+
+struct BlockRay {
+  explicit BlockRay(const Ray& r) {
+    auto o = r.origin();
+    auto d = r.direction();
+    origin[0] = BlockFloat::broadcast(o.x);
+    origin[1] = BlockFloat::broadcast(o.y);
+    origin[2] = BlockFloat::broadcast(o.z);
+    direction[0] = BlockFloat::broadcast(d.x);
+    direction[1] = BlockFloat::broadcast(d.y);
+    direction[2] = BlockFloat::broadcast(d.z);
+    length = BlockFloat::broadcast(static_cast<float>(d.magnitude()));
+    // rounding the origin and the vertices to float moves the difference by
+    // up to this much
+    auto reach = std::max({std::abs(o.x), std::abs(o.y), std::abs(o.z)});
+    slack = BlockFloat::broadcast(KERNEL_SLACK * (1 + 2 * reach));
+  }
+
+  BlockFloat origin[3];
+  BlockFloat direction[3];
+  BlockFloat length;
+  BlockFloat slack;
+};
+
+void cross(const BlockFloat* a, const BlockFloat* b, BlockFloat* out) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+BlockFloat dot(const BlockFloat* a, const BlockFloat* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+BlockFloat length(const BlockFloat* a) { return sqrt(dot(a, a)); }
+
+// Moller-Trumbore on every lane of the block at once; returns the lanes
+// hit at some t in [tmin, tmax]. The barycentrics and t are ratios over
+// the determinant, so an error in the float inputs moves them by that
+// error times the edge lengths over |det|; every bound is widened by as
+// much, which keeps the test conservative for thin triangles and for
+// meshes far from the origin.
+unsigned intersect_block(const TriangleBlock& block, const BlockRay& r,
+                         float tmin, float tmax) {
+  BlockFloat e1[3], e2[3], p1_to_origin[3];
+  for (int a = 0; a < 3; ++a) {
+    e1[a] = BlockFloat::load(block.e1[a]);
+    e2[a] = BlockFloat::load(block.e2[a]);
+    p1_to_origin[a] = r.origin[a] - BlockFloat::load(block.p1[a]);
+  }
+  const auto zero = BlockFloat::broadcast(0.0f);
+  const auto relative = BlockFloat::broadcast(KERNEL_SLACK);
+  const auto e1_length = length(e1);
+  const auto e2_length = length(e2);
+
+  BlockFloat dir_cross_e2[3];
+  cross(r.direction, e2, dir_cross_e2);
+  auto det = dot(e1, dir_cross_e2);
+  auto abs_det = max(det, zero - det);
+  auto det_slack = relative * e1_length * e2_length * r.length;
+  unsigned mask = abs_det + det_slack >= BlockFloat::broadcast(EPSILON);
+  mask &= (1u << block.count) - 1;
+  if (mask == 0) {
+    return 0;
+  }
+
+  // how far p1_to_origin may be from the exact difference
+  auto offset = r.slack + relative * length(p1_to_origin);
+  auto f = BlockFloat::broadcast(1.0f) / det;
+  auto inv_abs_det = BlockFloat::broadcast(1.0f) / abs_det;
+  auto u_slack =
+      relative + r.length * e2_length * (offset + relative * e1_length) *
+                     inv_abs_det;
+  auto u = f * dot(p1_to_origin, dir_cross_e2);
+  mask &= (u >= zero - u_slack) &
+          (u <= BlockFloat::broadcast(1.0f) + u_slack);
+
+  BlockFloat origin_cross_e1[3];
+  cross(p1_to_origin, e1, origin_cross_e1);
+  auto v_slack =
+      relative + r.length * e1_length * (offset + relative * e2_length) *
+                     inv_abs_det;
+  auto v = f * dot(r.direction, origin_cross_e1);
+  mask &= (v >= zero - v_slack) &
+          (u + v <= BlockFloat::broadcast(1.0f) + u_slack + v_slack);
+
+  auto t = f * dot(e2, origin_cross_e1);
+  auto t_bound = KERNEL_SLACK * (1 + std::max(std::abs(tmin), std::abs(tmax)));
+  auto t_slack =
+      BlockFloat::broadcast(t_bound) +
+      e1_length * e2_length *
+          (offset + relative * r.length * max(t, zero - t)) * inv_abs_det;
+  mask &= (t >= BlockFloat::broadcast(tmin) - t_slack) &
+          (t <= BlockFloat::broadcast(tmax) + t_slack);
+  return mask;
+}
+}  // namespace
+
+uint32_t TriangleMesh::add_vertex(const Tuple& p) {
+  x_.push_back(p.x);
+  y_.push_back(p.y);
+  z_.push_back(p.z);
+  return x_.size() - 1;
+}
+
+uint32_t TriangleMesh::add_normal(const Tuple& n) {
+  nx_.push_back(n.x);
+  ny_.push_back(n.y);
+  nz_.push_back(n.z);
+  return nx_.size() - 1;
+}
+
+void TriangleMesh::add_triangle(uint32_t a, uint32_t b, uint32_t c,
+                                uint32_t na, uint32_t nb, uint32_t nc) {
+  if (a >= x_.size() || b >= x_.size() || c >= x_.size()) {
+    throw std::runtime_error("triangle vertex index out of range");
+  }
+  const bool smooth = na != NO_NORMAL;
+  if (smooth && (na >= nx_.size() || nb >= nx_.size() || nc >= nx_.size())) {
+    throw std::runtime_error("triangle normal index out of range");
+  }
+
+  if (smooth && normal_indices_.empty()) {
+    normal_indices_.assign(indices_.size(), NO_NORMAL);
+  }
+  indices_.insert(indices_.end(), {a, b, c});
+  if (smooth || !normal_indices_.empty()) {
+    normal_indices_.insert(normal_indices_.end(), {na, nb, nc});
+  }
+
+  box_.add(vertex(a));
+  box_.add(vertex(b));
+  box_.add(vertex(c));
+  nodes_.clear();
+  blocks_.clear();
+  invalidate_commit();
+}
+
+void TriangleMesh::build(size_t leaf_size) {
+  nodes_.clear();
+  blocks_.clear();
+  leaf_size_ = leaf_size;
+  if (triangle_count() == 0) {
+    return;
+  }
+
+  std::vector<LinearBVH::BuildRef> refs(triangle_count());
+  for (uint32_t i = 0; i < refs.size(); ++i) {
+    auto [a, b, c] = triangle(i);
+    refs[i].index = i;
+    refs[i].bounds.add(vertex(a));
+    refs[i].bounds.add(vertex(b));
+    refs[i].bounds.add(vertex(c));
+    refs[i].centroid = refs[i].bounds.centroid();
+  }
+  nodes_ = LinearBVH::build_nodes(&refs, leaf_size);
+
+  // lay the triangles out in leaf order
+  std::vector<uint32_t> indices(indices_.size());
+  std::vector<uint32_t> normal_indices(normal_indices_.size());
+  for (size_t i = 0; i < refs.size(); ++i) {
+    auto from = 3 * refs[i].index;
+    std::copy_n(&indices_[from], 3, &indices[3 * i]);
+    if (!normal_indices_.empty()) {
+      std::copy_n(&normal_indices_[from], 3, &normal_indices[3 * i]);
+    }
+  }
+  indices_ = std::move(indices);
+  normal_indices_ = std::move(normal_indices);
+
+  build_blocks();
+}
+
+void TriangleMesh::bake_transform(const Matrix& m) {
+  const auto full = m * transform();
+  for (size_t i = 0; i < x_.size(); ++i) {
+    auto p = full * vertex(i);
+    x_[i] = p.x;
+    y_[i] = p.y;
+    z_[i] = p.z;
+  }
+  const auto normals = full.inverse().transpose();
+  for (size_t i = 0; i < nx_.size(); ++i) {
+    // not renormalized, as in SmoothTriangle::bake_transform()
+    auto n = normals * normal(i);
+    nx_[i] = n.x;
+    ny_[i] = n.y;
+    nz_[i] = n.z;
+  }
+  set_transform(Matrix(IDENTITY));
+
+  box_ = BoundingBox();
+  for (auto i : indices_) {
+    box_.add(vertex(i));
+  }
+  if (!nodes_.empty()) {
+    build(leaf_size_);
+  }
+}
+
+// Repoints every leaf from its triangle range to the blocks packing it.
+void TriangleMesh::build_blocks() {
+  blocks_.clear();
+  for (auto& node : nodes_) {
+    if (!node.leaf()) {
+      continue;
+    }
+    const auto first_block = static_cast<uint32_t>(blocks_.size());
+    for (uint32_t first = node.offset; first < node.offset + node.count;
+         first += TRIANGLE_BLOCK_WIDTH) {
+      TriangleBlock block{};
+      block.first = first;
+      block.count = std::min<uint32_t>(TRIANGLE_BLOCK_WIDTH,
+                                       node.offset + node.count - first);
+      for (uint32_t lane = 0; lane < block.count; ++lane) {
+        auto [a, b, c] = triangle(first + lane);
+        auto p1 = vertex(a);
+        auto e1 = vertex(b) - p1;
+        auto e2 = vertex(c) - p1;
+        block.p1[0][lane] = p1.x;
+        block.p1[1][lane] = p1.y;
+        block.p1[2][lane] = p1.z;
+        block.e1[0][lane] = e1.x;
+        block.e1[1][lane] = e1.y;
+        block.e1[2][lane] = e1.z;
+        block.e2[0][lane] = e2.x;
+        block.e2[1][lane] = e2.y;
+        block.e2[2][lane] = e2.z;
+      }
+      blocks_.push_back(block);
+    }
+    node.count = blocks_.size() - first_block;
+    node.offset = first_block;
+  }
+}
+
+size_t TriangleMesh::memory_bytes() const {
+  return bytes_of(x_) + bytes_of(y_) + bytes_of(z_) + bytes_of(nx_) +
+         bytes_of(ny_) + bytes_of(nz_) + bytes_of(indices_) +
+         bytes_of(normal_indices_) + bytes_of(nodes_) + bytes_of(blocks_);
+}
+
+bool TriangleMesh::hit(uint32_t tri, const Ray& r, double* t, double* u,
+                       double* v) const {
+  auto [a, b, c] = triangle(tri);
+  const Point3 p1(x_[a], y_[a], z_[a]);
+  const Vec3 e1 = Point3(x_[b], y_[b], z_[b]) - p1;
+  const Vec3 e2 = Point3(x_[c], y_[c], z_[c]) - p1;
+
+  auto dir_cross_e2 = cross(r.direction(), e2);
+  auto det = dot(e1, dir_cross_e2);
+  if (std::abs(det) < EPSILON) {
+    return false;
+  }
+  auto f = 1.0 / det;
+  auto p1_to_origin = r.origin() - p1;
+  *u = f * dot(p1_to_origin, dir_cross_e2);
+  if (*u < 0 || *u > 1) {
+    return false;
+  }
+
+  auto origin_cross_e1 = cross(p1_to_origin, e1);
+  *v = f * dot(r.direction(), origin_cross_e1);
+  if (*v < 0 || (*u + *v) > 1) {
+    return false;
+  }
+
+  *t = f * dot(e2, origin_cross_e1);
+  return true;
+}
+
+template <typename Fn>
+void TriangleMesh::for_each_candidate(const Ray& r, double tmin, double tmax,
+                                      Fn&& fn) const {
+  if (nodes_.empty()) {
+    float box_tmax = float_round_up(tmax);
+    for (uint32_t i = 0; i < triangle_count(); ++i) {
+      if (fn(i, &box_tmax)) {
+        return;
+      }
+    }
+    return;
+  }
+  const BlockRay block_ray(r);
+  const float block_tmin = float_round_down(tmin);
+  LinearBVH::traverse(
+      nodes_, r, block_tmin, float_round_up(tmax),
+      [&](uint32_t first, uint32_t count, float* box_tmax) {
+        for (uint32_t b = first; b < first + count; ++b) {
+          const auto& block = blocks_[b];
+          auto mask = intersect_block(block, block_ray, block_tmin, *box_tmax);
+          for (; mask != 0; mask &= mask - 1) {
+            if (fn(block.first + __builtin_ctz(mask), box_tmax)) {
+              return true;
+            }
+          }
+        }
+        return false;
+      });
+}
+
+void TriangleMesh::local_intersect_into(const Ray& r,
+                                        IntersectionVector* out) {
+  for_each_candidate(r, -INFINITY, INFINITY, [&](uint32_t tri, float*) {
+    double t, u, v;
+    if (hit(tri, r, &t, &u, &v)) {
+      out->push_back(Intersection(t, this, u, v, tri));
+    }
+    return false;
+  });
+}
+
+bool TriangleMesh::local_occluded(const Ray& r, double tmin, double tmax) {
+  bool found = false;
+  for_each_candidate(r, tmin, tmax, [&](uint32_t tri, float*) {
+    double t, u, v;
+    found = hit(tri, r, &t, &u, &v) && t >= tmin && t < tmax;
+    return found;
+  });
+  return found;
+}
+
+std::optional<Intersection> TriangleMesh::local_closest_hit(const Ray& r,
+                                                            double tmin,
+                                                            double tmax) {
+  std::optional<Intersection> out;
+  for_each_candidate(r, tmin, tmax, [&](uint32_t tri, float* box_tmax) {
+    double t, u, v;
+    if (hit(tri, r, &t, &u, &v) && t >= tmin && t < tmax) {
+      out = Intersection(t, this, u, v, tri);
+      tmax = t;
+      *box_tmax = float_round_up(tmax);
+    }
+    return false;
+  });
+  return out;
+}
+
+Tuple TriangleMesh::local_normal_at(const Tuple& p, const Intersection* i) {
+  if (i == nullptr) {
+    throw std::runtime_error("a mesh normal needs the hit triangle");
+  }
+  uint32_t tri = i->index();
+  if (!normal_indices_.empty() &&
+      normal_indices_[3 * tri] != NO_NORMAL) {
+    auto n1 = normal(normal_indices_[3 * tri]);
+    auto n2 = normal(normal_indices_[3 * tri + 1]);
+    auto n3 = normal(normal_indices_[3 * tri + 2]);
+    return n2 * i->u + n3 * i->v + n1 * (1 - i->u - i->v);
+  }
+  auto [a, b, c] = triangle(tri);
+  auto p1 = vertex(a);
+  return cross(vertex(c) - p1, vertex(b) - p1).normalize();
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include "../core/linear_bvh.h"
+#include "shape.h"
+
+// Triangles per SIMD block: one AVX register of floats, or SSE without it.
+#if defined(__AVX__)
+static constexpr size_t TRIANGLE_BLOCK_WIDTH = 8;
+#else
+static constexpr size_t TRIANGLE_BLOCK_WIDTH = 4;
+#endif
+
+// Up to TRIANGLE_BLOCK_WIDTH consecutive triangles of one BVH leaf in
+// structure-of-arrays form (first vertex and both edges), so one ray is
+// tested against all of them at once. Unused lanes are zero, which fails
+// the determinant test.
+struct alignas(32) TriangleBlock {
+  float p1[3][TRIANGLE_BLOCK_WIDTH];
+  float e1[3][TRIANGLE_BLOCK_WIDTH];
+  float e2[3][TRIANGLE_BLOCK_WIDTH];
+  uint32_t first;  // triangle in lane 0
+  uint32_t count;
+};
+
+using TriangleBlockVector =
+    std::vector<TriangleBlock, tbb::cache_aligned_allocator<TriangleBlock>>;
+
+// Many triangles sharing one material and transform. Vertex positions and
+// normals live in shared float arrays (one array per axis) and each
+// triangle is three indices into them, so a triangle costs a few dozen
+// bytes instead of a whole Shape. The mesh keeps its own BVH whose leaves
+// address triangles by index; hits report the triangle through
+// Intersection::index().
+//
+// Each leaf's triangles are also packed into TriangleBlocks. A leaf is
+// tested with a float SIMD kernel that rejects most triangles at once;
+// its tolerances grow with the distance from the origin and the shape of
+// each triangle, so it never drops one the Real test would hit. The lanes
+// it keeps are re-tested one by one with the same Real math as Triangle,
+// so hits (t, u, v) match Triangle and SmoothTriangle exactly.
+//
+// Triangles with normal indices are shaded like SmoothTriangle, the others
+// like Triangle.
+class TriangleMesh : public Shape {
+ public:
+  static constexpr uint32_t NO_NORMAL = UINT32_MAX;
+
+  bool compare(const Shape&) const noexcept override { return true; }
+
+  uint32_t add_vertex(const Tuple& p);
+  uint32_t add_normal(const Tuple& n);
+
+  void add_triangle(uint32_t a, uint32_t b, uint32_t c,
+                    uint32_t na = NO_NORMAL, uint32_t nb = NO_NORMAL,
+                    uint32_t nc = NO_NORMAL);
+
+  // Builds the triangle BVH (binned SAH, at most leaf_size triangles per
+  // leaf) and its blocks. Triangles are reordered so that every leaf is a
+  // contiguous range. Until this is called every ray is tested against
+  // every triangle.
+  void build(size_t leaf_size = TRIANGLE_BLOCK_WIDTH);
+
+  size_t triangle_count() const { return indices_.size() / 3; }
+  size_t vertex_count() const { return x_.size(); }
+
+  Tuple vertex(uint32_t i) const { return Tuple::point(x_[i], y_[i], z_[i]); }
+  Tuple normal(uint32_t i) const {
+    return Tuple::vector(nx_[i], ny_[i], nz_[i]);
+  }
+  std::array<uint32_t, 3> triangle(size_t i) const {
+    return {indices_[3 * i], indices_[3 * i + 1], indices_[3 * i + 2]};
+  }
+
+  // Leaves of nodes() hold a range of blocks() rather than of triangles.
+  const LinearBVHNodeVector& nodes() const { return nodes_; }
+  const TriangleBlockVector& blocks() const { return blocks_; }
+
+  // Bytes held by the vertex, index and BVH buffers.
+  size_t memory_bytes() const;
+
+  size_t size(bool recurse = false) const override { return triangle_count(); }
+
+  // Moves the vertices and normals into the parent's space, rebuilding the
+  // BVH if there was one.
+  void bake_transform(const Matrix& m) override;
+
+  void local_intersect_into(const Ray& r, IntersectionVector* out) override;
+  bool local_occluded(const Ray& r, double tmin, double tmax) override;
+  std::optional<Intersection> local_closest_hit(const Ray& r, double tmin,
+                                                double tmax) override;
+
+  // Needs the hit to know which triangle it is on; throws
+  // std::runtime_error without one.
+  Tuple local_normal_at(const Tuple& p, const Intersection* i) override;
+
+ private:
+  // Moller-Trumbore against triangle `tri`, as in Triangle::hit().
+  bool hit(uint32_t tri, const Ray& r, double* t, double* u, double* v) const;
+
+  // Calls fn(triangle, &tmax) for every triangle the ray may hit within
+  // [tmin, tmax]; fn may shrink tmax and returns true to stop.
+  template <typename Fn>
+  void for_each_candidate(const Ray& r, double tmin, double tmax, Fn&& fn) const;
+
+  void build_blocks();
+
+  std::vector<float> x_, y_, z_;
+  std::vector<float> nx_, ny_, nz_;
+  std::vector<uint32_t> indices_;
+  std::vector<uint32_t> normal_indices_;  // empty when no triangle has any
+  LinearBVHNodeVector nodes_;
+  TriangleBlockVector blocks_;
+  size_t leaf_size_ = TRIANGLE_BLOCK_WIDTH;
+};
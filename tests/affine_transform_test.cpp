@@ -0,0 +1,95 @@
+#include "../core/affine_transform.h"
+
+#include "../core/bounding_box.h"
+#include "../core/matrix.h"
+#include "../core/ray.h"
+#include "test_common.h"
+#include "gtest/gtest.h"
+
+namespace {
+Matrix Sample() {
+  return CreateTranslation(5, -3, 2) * CreateRotationY(PI_4) *
+         CreateShearing(1, 0, 0.5, 0, 0, 1) * CreateScaling(2, 3, 4);
+}
+}  // namespace
+
+TEST(AffineTransform, Identity) {
+  EXPECT_EQ(Matrix(IDENTITY), AffineTransform().matrix());
+  EXPECT_EQ(Point3(1, 2, 3), AffineTransform() * Point3(1, 2, 3));
+}
+
+TEST(AffineTransform, RoundTrip) {
+  auto m = Sample();
+  EXPECT_TRUE(matrix_is_near(m, AffineTransform(m).matrix(), REAL_TOLERANCE));
+}
+
+TEST(AffineTransform, MatchesMatrix) {
+  auto m = Sample();
+  AffineTransform a(m);
+
+  EXPECT_EQ(m * Tuple::point(-3, 4, 5), a * Tuple::point(-3, 4, 5));
+  EXPECT_EQ(m * Tuple::vector(-3, 4, 5), a * Tuple::vector(-3, 4, 5));
+  EXPECT_EQ(m * Tuple::point(-3, 4, 5), Tuple(a * Point3(-3, 4, 5)));
+  EXPECT_EQ(m * Tuple::vector(-3, 4, 5), Tuple(a * Vec3(-3, 4, 5)));
+}
+
+TEST(AffineTransform, Multiply) {
+  auto m = CreateRotationX(PI_3) * CreateTranslation(1, 2, 3);
+  auto n = Sample();
+  auto product = (AffineTransform(m) * AffineTransform(n)).matrix();
+  auto expected = m * n;
+  for (size_t row = 0; row < 4; ++row) {
+    for (size_t col = 0; col < 4; ++col) {
+      EXPECT_NEAR(expected.get(row, col), product.get(row, col), REAL_TOLERANCE);
+    }
+  }
+}
+
+TEST(AffineTransform, Inverse) {
+  auto m = Sample();
+  auto inverse = AffineTransform(m).inverse().matrix();
+  auto expected = m.inverse();
+  for (size_t row = 0; row < 4; ++row) {
+    for (size_t col = 0; col < 4; ++col) {
+      EXPECT_NEAR(expected.get(row, col), inverse.get(row, col), REAL_TOLERANCE);
+    }
+  }
+
+  AffineTransform a(m);
+  EXPECT_EQ(Point3(-3, 4, 5), a.inverse() * (a * Point3(-3, 4, 5)));
+}
+
+TEST(AffineTransform, NormalMatrix) {
+  auto m = CreateScaling(1, 0.5, 1) * CreateRotationZ(PI / 5);
+  auto expected = m.inverse().transpose() * Tuple::vector(0, SQRT2_2, -SQRT2_2);
+  expected.w = 0;
+
+  auto normals = AffineTransform(m).inverse().linear_transpose();
+  EXPECT_EQ(expected, Tuple(normals * Normal3(0, SQRT2_2, -SQRT2_2)));
+}
+
+TEST(AffineTransform, Ray) {
+  // Scenario: Scaling a ray
+  Ray r(Point3(1, 2, 3), Vec3(0, 1, 0));
+  auto r2 = r.transform(AffineTransform(CreateScaling(2, 3, 4)));
+  EXPECT_EQ(Point3(2, 6, 12), r2.origin());
+  EXPECT_EQ(Vec3(0, 3, 0), r2.direction());
+}
+
+TEST(AffineTransform, BoundingBox) {
+  BoundingBox box(Tuple::point(-1, -1, -1), Tuple::point(1, 1, 1));
+  auto m = CreateRotationX(PI_4) * CreateRotationY(PI_4);
+
+  BoundingBox corners;
+  for (double x : {-1, 1}) {
+    for (double y : {-1, 1}) {
+      for (double z : {-1, 1}) {
+        corners.add(m * Tuple::point(x, y, z));
+      }
+    }
+  }
+
+  auto out = box.transform(AffineTransform(m));
+  EXPECT_EQ(corners.min(), out.min());
+  EXPECT_EQ(corners.max(), out.max());
+}
@@ -0,0 +1,601 @@
+#include "../core/bvh.h"
+#include "../core/wide_bvh.h"
+
+#include "../shapes/group.h"
+#include "../shapes/cube.h"
+#include "../shapes/plane.h"
+#include "../shapes/primitive.h"
+#include "../shapes/sphere.h"
+#include "../shapes/triangle.h"
+#include "gtest/gtest.h"
+
+namespace {
+size_t count_leaf_primitives(Group* g) {
+  size_t count = 0;
+  for (const auto& c : g->children()) {
+    auto sub = dynamic_cast<Group*>(c);
+    count += sub == nullptr ? 1 : count_leaf_primitives(sub);
+  }
+  return count;
+}
+
+size_t max_leaf_size(Group* g) {
+  size_t direct = 0;
+  size_t out = 0;
+  for (const auto& c : g->children()) {
+    auto sub = dynamic_cast<Group*>(c);
+    if (sub == nullptr) {
+      direct++;
+    } else {
+      out = std::max(out, max_leaf_size(sub));
+    }
+  }
+  return std::max(out, direct);
+}
+}  // namespace
+
+TEST(BVH, SurfaceArea) {
+  auto box = BoundingBox(Tuple::point(-1, -1, -1), Tuple::point(1, 2, 3));
+  EXPECT_DOUBLE_EQ(2 * (2 * 3 + 3 * 4 + 4 * 2), box.surface_area());
+  EXPECT_EQ(Tuple::point(0, 0.5, 1), box.centroid());
+  EXPECT_TRUE(box.bounded());
+  EXPECT_FALSE(BoundingBox().bounded());
+  EXPECT_DOUBLE_EQ(0.0, BoundingBox().surface_area());
+}
+
+TEST(BVH, SmallGroupUnchanged) {
+  auto s1 = std::make_shared<Sphere>();
+  auto s2 = std::make_shared<Sphere>();
+  s2->set_transform(CreateTranslation(4, 0, 0));
+
+  auto g = Group();
+  g.add(s1.get());
+  g.add(s2.get());
+
+  auto stats = BVHBuilder().build(&g);
+  EXPECT_EQ(2, stats.primitives);
+  EXPECT_EQ(2, g.size());
+  EXPECT_EQ(&g, s1->parent());
+}
+
+TEST(BVH, EveryPrimitiveInOneLeaf) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 100; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, (i % 7) * 2, (i % 3) * 5) *
+                     CreateScaling(1 + (i % 4), 1, 1));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+
+  BVHBuildOptions options;
+  options.leaf_size = 4;
+  auto stats = BVHBuilder(options).build(&g);
+
+  EXPECT_EQ(100, stats.primitives);
+  EXPECT_EQ(100, count_leaf_primitives(&g));
+  EXPECT_LE(max_leaf_size(&g), 4);
+  EXPECT_GT(stats.leaves, 1);
+  EXPECT_GT(stats.sah_cost, 0.0);
+  for (const auto& s : spheres) {
+    EXPECT_NE(nullptr, s->parent());
+  }
+}
+
+TEST(BVH, StraddlingChildrenAreSplit) {
+  // divide() leaves the big sphere in the parent; the SAH builder doesn't
+  auto s1 = std::make_shared<Sphere>();
+  s1->set_transform(CreateTranslation(-2, -2, 0));
+  auto s2 = std::make_shared<Sphere>();
+  s2->set_transform(CreateTranslation(-2, 2, 0));
+  auto s3 = std::make_shared<Sphere>();
+  s3->set_transform(CreateScaling(4, 4, 4));
+
+  auto g = Group();
+  g.add(s1.get());
+  g.add(s2.get());
+  g.add(s3.get());
+
+  BVHBuildOptions options;
+  options.leaf_size = 1;
+  BVHBuilder(options).build(&g);
+
+  EXPECT_EQ(2, g.size());
+  EXPECT_EQ(3, count_leaf_primitives(&g));
+  EXPECT_LE(max_leaf_size(&g), 2);
+}
+
+TEST(BVH, MaxDepthForcesLeaves) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 64; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+
+  BVHBuildOptions options;
+  options.leaf_size = 1;
+  options.max_depth = 2;
+  auto stats = BVHBuilder(options).build(&g);
+
+  EXPECT_LE(stats.depth, 2);
+  EXPECT_EQ(64, count_leaf_primitives(&g));
+}
+
+TEST(BVH, PlanesStayAtRoot) {
+  auto p = std::make_shared<Plane>();
+  auto g = Group();
+  g.add(p.get());
+
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  for (int i = 0; i < 10; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+
+  BVHBuilder().build(&g);
+  EXPECT_EQ(&g, p->parent());
+  EXPECT_EQ(11, count_leaf_primitives(&g));
+}
+
+TEST(BVH, SameIntersectionsAfterBuild) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 30; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3 - 45, (i % 5) - 2, 0));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+
+  auto r = Ray(Tuple::point(-60, 0, 0), Tuple::vector(1, 0, 0));
+  auto before = g.intersects(r);
+
+  BVHBuilder().build(&g);
+  auto after = g.intersects(r);
+
+  ASSERT_EQ(before.size(), after.size());
+  for (size_t i = 0; i < before.size(); ++i) {
+    EXPECT_EQ(before[i], after[i]);
+  }
+}
+
+TEST(LinearBVH, NodeLayout) {
+  EXPECT_EQ(32, sizeof(LinearBVHNode));
+  EXPECT_EQ(32, alignof(LinearBVHNode));
+}
+
+TEST(LinearBVH, EmptyGroup) {
+  auto g = Group();
+  auto bvh = g.build_linear_bvh();
+  EXPECT_TRUE(bvh->nodes().empty());
+  auto r = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+  EXPECT_TRUE(g.local_intersect(r).empty());
+}
+
+TEST(LinearBVH, FlattensEveryPrimitive) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 50; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, (i % 7) * 2, (i % 3) * 5));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+  BVHBuilder().build(&g);
+  auto bvh = g.build_linear_bvh();
+
+  EXPECT_EQ(50, bvh->primitives().size());
+  EXPECT_TRUE(bvh->nodes()[0].count == 0);
+
+  size_t in_leaves = 0;
+  for (const auto& n : bvh->nodes()) {
+    in_leaves += n.count;
+    EXPECT_LE(n.min[0], n.max[0]);
+  }
+  EXPECT_EQ(50, in_leaves);
+}
+
+TEST(LinearBVH, SameIntersectionsAsGroups) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 40; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 1.5 - 30, (i % 5) - 2, i % 3) *
+                     CreateScaling(1, 0.5 + (i % 2), 1));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+  auto p = std::make_shared<Plane>();
+  p->set_transform(CreateTranslation(0, -4, 0));
+  g.add(p.get());
+
+  BVHBuilder().build(&g);
+
+  std::vector<Ray> rays = {
+      Ray(Tuple::point(-60, 0, 0), Tuple::vector(1, 0, 0)),
+      Ray(Tuple::point(60, 0.5, 1), Tuple::vector(-1, 0, 0)),
+      Ray(Tuple::point(0, 10, 0), Tuple::vector(0.1, -1, 0.05).normalize()),
+      Ray(Tuple::point(-5, 0, -10), Tuple::vector(0, 0, 1)),
+  };
+
+  std::vector<IntersectionVector> expected;
+  for (const auto& r : rays) {
+    expected.push_back(g.intersects(r));
+  }
+
+  g.build_linear_bvh();
+  ASSERT_NE(nullptr, g.linear_bvh());
+  for (size_t i = 0; i < rays.size(); ++i) {
+    auto xs = g.intersects(rays[i]);
+    ASSERT_EQ(expected[i].size(), xs.size());
+    for (size_t j = 0; j < xs.size(); ++j) {
+      EXPECT_EQ(expected[i][j], xs[j]);
+    }
+  }
+}
+
+namespace {
+// Only exact types get a kind, so this one is dispatched virtually.
+class TaggedSphere : public Sphere {};
+}  // namespace
+
+TEST(LinearBVH, KindsGroupedInLeaves) {
+  std::vector<std::shared_ptr<Shape>> shapes;
+  auto g = Group();
+  auto add = [&](std::shared_ptr<Shape> s, int i) {
+    s->set_transform(CreateTranslation((i % 4) * 1.5, (i / 4 % 4) * 1.5,
+                                       (i / 16) * 1.5) *
+                     CreateScaling(0.6, 0.6, 0.6));
+    g.add(s.get());
+    shapes.push_back(s);
+  };
+  for (int i = 0; i < 48; ++i) {
+    switch (i % 5) {
+      case 0:
+        add(std::make_shared<Sphere>(), i);
+        break;
+      case 1:
+        add(std::make_shared<Cube>(), i);
+        break;
+      case 2:
+        add(std::make_shared<Triangle>(Tuple::point(0, 1, 0),
+                                       Tuple::point(-1, 0, 0),
+                                       Tuple::point(1, 0, 0)),
+            i);
+        break;
+      case 3:
+        add(std::make_shared<SmoothTriangle>(
+                Tuple::point(0, 1, 0), Tuple::point(-1, 0, 0),
+                Tuple::point(1, 0, 0), Tuple::vector(0, 1, -1).normalize(),
+                Tuple::vector(-1, 0, -1).normalize(),
+                Tuple::vector(1, 0, -1).normalize()),
+            i);
+        break;
+      default:
+        add(std::make_shared<TaggedSphere>(), i);
+    }
+  }
+  std::vector<Ray> rays;
+  for (int i = 0; i < 100; ++i) {
+    auto origin =
+        Tuple::point((i % 10) * 0.55 - 0.3, (i / 10) * 0.55 - 0.3, -5);
+    auto direction = Tuple::vector(0.05 * (i % 3), 0.02, 1).normalize();
+    rays.emplace_back(origin, direction);
+  }
+
+  std::vector<std::optional<Intersection>> nearest;
+  std::vector<IntersectionVector> all;
+  for (const auto& r : rays) {
+    nearest.push_back(g.closest_hit(r, 0, INFINITY));
+    all.push_back(g.intersects(r));
+  }
+
+  BVHBuilder().build(&g);
+  auto bvh = g.build_linear_bvh();
+  ASSERT_EQ(bvh->primitives().size(), bvh->kinds().size());
+  for (size_t i = 0; i < bvh->primitives().size(); ++i) {
+    EXPECT_EQ(primitive_kind(bvh->primitives()[i]), bvh->kinds()[i]);
+  }
+  for (const auto& n : bvh->nodes()) {
+    for (uint32_t i = n.offset + 1; n.leaf() && i < n.offset + n.count; ++i) {
+      EXPECT_LE(bvh->kinds()[i - 1], bvh->kinds()[i]);
+    }
+  }
+  EXPECT_EQ(PrimitiveKind::OTHER, primitive_kind(shapes[4].get()));
+
+  int hits = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    auto hit = g.closest_hit(rays[i], 0, INFINITY);
+    ASSERT_EQ(nearest[i].has_value(), hit.has_value()) << i;
+    if (hit) {
+      EXPECT_EQ(*nearest[i], *hit);
+      EXPECT_DOUBLE_EQ(nearest[i]->u, hit->u);
+      EXPECT_TRUE(g.occluded(rays[i], 0, INFINITY));
+      hits++;
+    }
+    EXPECT_EQ(all[i].size(), g.intersects(rays[i]).size()) << i;
+  }
+  EXPECT_GT(hits, 30);
+}
+
+TEST(LinearBVH, TransformedSubgroupIsAPrimitive) {
+  auto s = std::make_shared<Sphere>();
+  auto sub = std::make_shared<Group>();
+  sub->set_transform(CreateTranslation(5, 0, 0));
+  sub->add(s.get());
+
+  auto g = Group();
+  g.add(sub.get());
+  auto bvh = g.build_linear_bvh();
+
+  ASSERT_EQ(1, bvh->primitives().size());
+  EXPECT_EQ(sub.get(), bvh->primitives()[0]);
+
+  auto r = Ray(Tuple::point(5, 0, -5), Tuple::vector(0, 0, 1));
+  auto xs = g.local_intersect(r);
+  ASSERT_EQ(2, xs.size());
+  EXPECT_EQ(s.get(), xs[0].object());
+}
+
+TEST(LinearBVH, AddingChildInvalidates) {
+  auto s1 = std::make_shared<Sphere>();
+  auto s2 = std::make_shared<Sphere>();
+  auto g = Group();
+  g.add(s1.get());
+  g.build_linear_bvh();
+  g.add(s2.get());
+  EXPECT_EQ(nullptr, g.linear_bvh());
+}
+
+TEST(BVH, ParallelBuildMatchesSerial) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto serial = Group();
+  auto parallel = Group();
+  for (int i = 0; i < 500; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation((i * 37) % 101, (i * 13) % 29,
+                                       (i * 7) % 17) *
+                     CreateScaling(0.5 + (i % 3), 1, 1));
+    serial.add(s.get());
+    spheres.push_back(s);
+  }
+  auto serial_stats = BVHBuilder().build(&serial);
+
+  for (const auto& s : spheres) {
+    parallel.add(s.get());
+  }
+  BVHBuildOptions options;
+  options.parallel = true;
+  options.parallel_threshold = 16;
+  auto parallel_stats = BVHBuilder(options).build(&parallel);
+
+  EXPECT_EQ(500, count_leaf_primitives(&parallel));
+  EXPECT_EQ(serial_stats.leaves, parallel_stats.leaves);
+  EXPECT_EQ(serial_stats.interior_nodes, parallel_stats.interior_nodes);
+  EXPECT_EQ(serial_stats.depth, parallel_stats.depth);
+  EXPECT_DOUBLE_EQ(serial_stats.sah_cost, parallel_stats.sah_cost);
+
+  auto r = Ray(Tuple::point(-10, 3, 2), Tuple::vector(1, 0.1, 0.05).normalize());
+  auto xs = parallel.intersects(r);
+  EXPECT_FALSE(xs.empty());
+}
+
+TEST(BVH, RefitFollowsMovedChildren) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 20; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+  BVHBuildOptions options;
+  options.rebuild_threshold = 1000;
+  auto builder = BVHBuilder(options);
+  auto stats = builder.build(&g);
+  g.build_linear_bvh();
+
+  // move every sphere up; without a refit the stale boxes miss them
+  for (int i = 0; i < 20; ++i) {
+    spheres[i]->set_transform(CreateTranslation(i * 3, 10, 0));
+  }
+  auto r = Ray(Tuple::point(-10, 10, 0), Tuple::vector(1, 0, 0));
+  EXPECT_TRUE(g.intersects(r).empty());
+
+  auto updated = builder.update(&g, stats);
+  EXPECT_FALSE(updated.rebuilt);
+  EXPECT_EQ(stats.leaves, updated.leaves);
+  ASSERT_NE(nullptr, g.linear_bvh());
+  EXPECT_EQ(40, g.intersects(r).size());
+}
+
+TEST(BVH, UpdateRebuildsWhenQualityDegrades) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 32; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+  auto builder = BVHBuilder();
+  auto stats = builder.build(&g);
+  g.build_wide_bvh(4);
+
+  // scramble the positions so the old topology has terrible boxes
+  for (int i = 0; i < 32; ++i) {
+    spheres[i]->set_transform(CreateTranslation(((i * 17) % 32) * 3, 0, 0));
+  }
+  auto updated = builder.update(&g, stats);
+  EXPECT_TRUE(updated.rebuilt);
+  EXPECT_EQ(32, count_leaf_primitives(&g));
+  EXPECT_LE(updated.sah_cost, stats.sah_cost * 1.5);
+  // the flattened BVHs are rebuilt too, over the new hierarchy
+  ASSERT_NE(nullptr, g.linear_bvh());
+  ASSERT_NE(nullptr, g.wide_bvh());
+  EXPECT_EQ(4, g.wide_bvh()->width());
+  auto r = Ray(Tuple::point(-10, 0, 0), Tuple::vector(1, 0, 0));
+  EXPECT_EQ(64, g.intersects(r).size());
+}
+
+TEST(WideBVH, NodeLayout) {
+  EXPECT_EQ(128, sizeof(WideBVHNode<4>));
+  EXPECT_EQ(256, sizeof(WideBVHNode<8>));
+  EXPECT_EQ(64, alignof(WideBVHNode<8>));
+}
+
+TEST(WideBVH, SameIntersectionsAsLinear) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 200; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 0.7 - 70, (i % 7) - 3, (i % 11) - 5) *
+                     CreateScaling(0.5, 0.5 + (i % 3) * 0.25, 0.5));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+  auto p = std::make_shared<Plane>();
+  p->set_transform(CreateTranslation(0, -4, 0));
+  g.add(p.get());
+
+  BVHBuilder().build(&g);
+  g.build_linear_bvh();
+
+  std::vector<Ray> rays = {
+      Ray(Tuple::point(-80, 0, 0), Tuple::vector(1, 0, 0)),
+      Ray(Tuple::point(80, 0.5, 1), Tuple::vector(-1, 0, 0)),
+      Ray(Tuple::point(0, 10, 0), Tuple::vector(0.1, -1, 0.05).normalize()),
+      Ray(Tuple::point(-5, 0, -10), Tuple::vector(0, 0, 1)),
+      Ray(Tuple::point(-30, 20, -20), Tuple::vector(1, -1, 1).normalize()),
+      Ray(Tuple::point(0, 100, 0), Tuple::vector(0, 1, 0)),
+  };
+
+  std::vector<IntersectionVector> expected;
+  for (const auto& r : rays) {
+    expected.push_back(g.intersects(r));
+  }
+
+  for (size_t width : {4, 8}) {
+    auto wide = g.build_wide_bvh(width);
+    ASSERT_NE(nullptr, wide);
+    EXPECT_EQ(width, wide->width());
+    for (size_t i = 0; i < rays.size(); ++i) {
+      auto xs = g.intersects(rays[i]);
+      ASSERT_EQ(expected[i].size(), xs.size()) << "width " << width;
+      for (size_t j = 0; j < xs.size(); ++j) {
+        EXPECT_EQ(expected[i][j], xs[j]);
+      }
+    }
+  }
+
+  EXPECT_EQ(nullptr, g.build_wide_bvh(2));
+  EXPECT_THROW(g.build_wide_bvh(3), std::runtime_error);
+}
+
+TEST(WideBVH, CollapsesBinaryNodes) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = Group();
+  for (int i = 0; i < 64; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    g.add(s.get());
+    spheres.push_back(s);
+  }
+  BVHBuildOptions options;
+  options.leaf_size = 1;
+  BVHBuilder(options).build(&g);
+  auto linear = g.build_linear_bvh();
+
+  WideBVH4 bvh4(*linear);
+  WideBVH8 bvh8(*linear);
+  EXPECT_EQ(linear->primitives(), bvh4.primitives());
+  EXPECT_LT(bvh4.nodes().size(), linear->nodes().size() / 2);
+  EXPECT_LT(bvh8.nodes().size(), bvh4.nodes().size());
+
+  // every primitive is reachable from exactly one leaf slot
+  std::vector<int> seen(64, 0);
+  for (const auto& n : bvh8.nodes()) {
+    for (size_t i = 0; i < 8; ++i) {
+      if ((n.valid & (1u << i)) && n.count[i] > 0) {
+        for (uint32_t p = n.child[i]; p < n.child[i] + n.count[i]; ++p) {
+          seen[p]++;
+        }
+      }
+    }
+  }
+  EXPECT_EQ(std::vector<int>(64, 1), seen);
+}
+
+TEST(WideBVH, RefitFollowsMovedChildren) {
+  auto a = std::make_shared<Sphere>();
+  auto b = std::make_shared<Sphere>();
+  auto c = std::make_shared<Sphere>();
+  a->set_transform(CreateTranslation(-10, 0, 0));
+  b->set_transform(CreateTranslation(0, 0, 0));
+  c->set_transform(CreateTranslation(10, 0, 0));
+  auto g = Group();
+  g.add(a.get());
+  g.add(b.get());
+  g.add(c.get());
+
+  BVHBuildOptions options;
+  options.leaf_size = 1;
+  BVHBuilder(options).build(&g);
+  g.build_wide_bvh(4);
+
+  auto r = Ray(Tuple::point(0, 20, -5), Tuple::vector(0, 0, 1));
+  EXPECT_TRUE(g.intersects(r).empty());
+
+  b->set_transform(CreateTranslation(0, 20, 0));
+  g.refit();
+  ASSERT_NE(nullptr, g.wide_bvh());
+  EXPECT_EQ(2, g.intersects(r).size());
+}
+
+TEST(LinearBVH, DeeperThanTraversalStack) {
+  // a chain of hand-nested groups, one sphere per level, far deeper than the
+  // traversal stacks hold inline
+  const int depth = 1000;
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  std::vector<std::shared_ptr<Group>> groups;
+  groups.push_back(std::make_shared<Group>());
+  for (int i = 0; i < depth; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    groups.back()->add(s.get());
+    spheres.push_back(s);
+    auto sub = std::make_shared<Group>();
+    groups.back()->add(sub.get());
+    groups.push_back(sub);
+  }
+  auto& root = *groups.front();
+
+  std::vector<Ray> rays = {
+      Ray(Tuple::point(-10, 0, 0), Tuple::vector(1, 0, 0)),
+      Ray(Tuple::point(depth * 3 + 10, 0, 0), Tuple::vector(-1, 0, 0)),
+  };
+  std::vector<IntersectionVector> expected;
+  for (const auto& r : rays) {
+    expected.push_back(root.intersects(r));
+    ASSERT_EQ(2 * depth, expected.back().size());
+  }
+
+  ASSERT_NE(nullptr, root.build_linear_bvh());
+  for (size_t width : {0, 4, 8}) {
+    if (width > 0) {
+      ASSERT_NE(nullptr, root.build_wide_bvh(width));
+    }
+    for (size_t i = 0; i < rays.size(); ++i) {
+      auto xs = root.intersects(rays[i]);
+      ASSERT_EQ(expected[i].size(), xs.size()) << width;
+      EXPECT_EQ(expected[i].front(), xs.front()) << width;
+      EXPECT_EQ(expected[i].back(), xs.back()) << width;
+    }
+  }
+}
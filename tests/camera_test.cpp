@@ -1,8 +1,14 @@
 #include "../core/camera.h"
 
+#include <chrono>
 #include <cmath>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #include "../core/world.h"
+#include "folly/executors/CPUThreadPoolExecutor.h"
+#include "folly/experimental/coro/BlockingWait.h"
 #include "gtest/gtest.h"
 #include "test_common.h"
 
@@ -66,6 +72,7 @@ TEST(Camera, RayWithTransformedCamera) {
 
 TEST(Camera, RenderWorld) {
   auto w = World::default_world();
+  w.commit();
   auto c = Camera(11, 11, PI_2);
   auto from = Tuple::point(0, 0, -5);
   auto to = Tuple::point(0, 0, 0);
@@ -77,3 +84,155 @@ TEST(Camera, RenderWorld) {
   auto actual = image.pixel_at(5, 5);
   EXPECT_TRUE(tuple_is_near(expected, actual)) << expected << " != " << actual;
 }
+
+TEST(Camera, RenderEveryPixel) {
+  auto w = World::default_world();
+  auto c = Camera(11, 11, PI_2);
+  c.set_transform(view_transform(Tuple::point(0, 0, -1.1),
+                                 Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  EXPECT_THROW(c.render(w), std::runtime_error);
+  w.commit();
+  auto image = c.render(w);
+  // the sphere fills the view, out to the last row and column
+  EXPECT_NE(Color(0, 0, 0), image.pixel_at(10, 10));
+  EXPECT_NE(Color(0, 0, 0), image.pixel_at(0, 10));
+}
+
+TEST(Camera, RenderSameForAnyTiling) {
+  auto w = World::default_world();
+  w.commit();
+  auto c = Camera(37, 23, PI_2);
+  c.set_transform(view_transform(Tuple::point(0, 0, -5), Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  RenderOptions serial;
+  serial.tile_size = 64;
+  serial.order = TileOrder::SCANLINE;
+  serial.threads = 1;
+  auto expected = c.render(w, serial);
+
+  for (auto order : {TileOrder::SCANLINE, TileOrder::MORTON, TileOrder::HILBERT}) {
+    for (size_t tile_size : {1, 5, 16}) {
+      RenderOptions options;
+      options.tile_size = tile_size;
+      options.order = order;
+      options.threads = 4;
+      RenderStats stats;
+      auto image = c.render(w, options, &stats);
+      EXPECT_EQ(make_tiles(37, 23, tile_size, order).size(), stats.tiles.size());
+      EXPECT_EQ(0, difference(expected, image).pixels) << tile_size;
+    }
+  }
+
+  RenderOptions none;
+  none.samples = 0;
+  EXPECT_THROW(c.render(w, none), std::runtime_error);
+}
+
+namespace {
+// Never hit; remembers which threads traced rays against it. Each ray takes
+// a little while, so a tile lasts long enough for others to start.
+class ThreadRecorder : public Shape {
+ public:
+  bool compare(const Shape&) const noexcept override { return true; }
+
+  void local_intersect_into(const Ray&, IntersectionVector*) override {
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+    std::lock_guard<std::mutex> lock(mutex_);
+    threads_.insert(std::this_thread::get_id());
+  }
+
+  Tuple local_normal_at(const Tuple& p, const Intersection*) override {
+    return Tuple::vector(0, 0, 1);
+  }
+
+  size_t threads() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threads_.size();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::set<std::thread::id> threads_;
+};
+}  // namespace
+
+TEST(Camera, RenderAsync) {
+  auto w = World::default_world();
+  w.commit();
+  auto c = Camera(37, 23, PI_2);
+  c.set_transform(view_transform(Tuple::point(0, 0, -5), Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  RenderOptions options;
+  options.tile_size = 8;
+  auto expected = c.render(w, options);
+  auto image = folly::coro::blockingWait(c.render_async(w, options, 3));
+  EXPECT_EQ(0, difference(expected, image).pixels);
+
+  // on a thread pool the tiles in the window run side by side
+  ThreadRecorder recorder;
+  w.add(&recorder);
+  w.commit();
+  folly::CPUThreadPoolExecutor ex(4);
+  image = folly::coro::blockingWait(
+      c.render_async(w, options, 4).scheduleOn(&ex));
+  EXPECT_EQ(0, difference(expected, image).pixels);
+  EXPECT_GT(recorder.threads(), 1);
+}
+
+TEST(Camera, RenderAdaptive) {
+  auto w = World::default_world();
+  w.commit();
+  auto c = Camera(37, 23, PI_2);
+  c.set_transform(view_transform(Tuple::point(0, 0, -5), Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  RenderOptions fixed;
+  fixed.samples = 64;
+  RenderStats fixed_stats;
+  auto expected = c.render(w, fixed, &fixed_stats);
+
+  RenderOptions adaptive = fixed;
+  adaptive.tolerance = 0.01;
+  RenderStats stats;
+  auto image = c.render(w, adaptive, &stats);
+  // flat shaded pixels stop at min_samples, only the edges need more
+  EXPECT_LT(stats.rays * 2, fixed_stats.rays);
+  EXPECT_LT(difference(expected, image).rms, 0.01);
+
+  adaptive.min_samples = 1;
+  EXPECT_THROW(c.render(w, adaptive), std::runtime_error);
+}
+
+TEST(Camera, RenderDeterministic) {
+  auto w = World::default_world();
+  w.commit();
+  auto light = AreaLight(Tuple::point(-11, 9, -11), Tuple::vector(2, 0, 0), 4,
+                         Tuple::vector(0, 2, 0), 4, Color(1, 1, 1));
+  w.set_light(&light);
+  auto c = Camera(37, 23, PI_2);
+  c.set_transform(view_transform(Tuple::point(0, 0, -5), Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  for (size_t samples : {1, 4}) {
+    RenderOptions serial;
+    serial.samples = samples;
+    serial.threads = 1;
+    serial.tile_size = 64;
+    auto expected = c.render(w, serial);
+
+    RenderOptions options = serial;
+    options.threads = 4;
+    options.tile_size = 3;
+    options.order = TileOrder::MORTON;
+    auto image = c.render(w, options);
+    EXPECT_EQ(0, difference(expected, image).max) << samples;
+    image = folly::coro::blockingWait(c.render_async(w, options, 5));
+    EXPECT_EQ(0, difference(expected, image).max) << samples;
+  }
+
+  // another frame has other noise
+  RenderOptions frame;
+  frame.samples = 4;
+  auto first = c.render(w, frame);
+  frame.sampler = make_sampler("random", 4, 1);
+  EXPECT_GT(difference(first, c.render(w, frame)).max, 0);
+}
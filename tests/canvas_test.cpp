@@ -151,4 +151,36 @@ TEST(CanvasTest, EndWithNewline) {
 
   // Then ppm ends with a newline character
   EXPECT_EQ('\n', ppm.at(ppm.size() - 1));
-}
\ No newline at end of file
+}
+TEST(CanvasTest, ReadPPM) {
+  auto c = Canvas(5, 3);
+  c.write_pixel(0, 0, Color(1.5, 0, 0));
+  c.write_pixel(2, 1, Color(0, 0.5, 0));
+  c.write_pixel(4, 2, Color(-0.5, 0, 1));
+
+  std::istringstream in(c.to_ppm());
+  auto read = Canvas::from_ppm(in);
+  ASSERT_EQ(5, read.width());
+  ASSERT_EQ(3, read.height());
+  EXPECT_EQ(Color(1, 0, 0), read.pixel_at(0, 0));
+  EXPECT_NEAR(0.5, read.pixel_at(2, 1).g(), 1.0 / 255);
+  EXPECT_EQ(Color(0, 0, 1), read.pixel_at(4, 2));
+
+  std::istringstream bad("P6\n5 3\n255\n");
+  EXPECT_THROW(Canvas::from_ppm(bad), std::runtime_error);
+}
+
+TEST(CanvasTest, Difference) {
+  auto a = Canvas(4, 2);
+  auto b = Canvas(4, 2);
+  b.write_pixel(1, 1, Color(0.5, 0, 0));
+  b.write_pixel(3, 0, Color(0, 0, 0.25));
+
+  auto d = difference(a, b);
+  EXPECT_DOUBLE_EQ(0.5, d.max);
+  EXPECT_DOUBLE_EQ(std::sqrt((0.25 + 0.0625) / 24), d.rms);
+  EXPECT_EQ(2u, d.pixels);
+
+  EXPECT_EQ(0u, difference(a, a).pixels);
+  EXPECT_THROW(difference(a, Canvas(2, 4)), std::runtime_error);
+}
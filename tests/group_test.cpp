@@ -2,6 +2,9 @@
 #include "../shapes/group.h"
 #include "../shapes/sphere.h"
 #include "../shapes/shape.h"
+#include "../shapes/triangle.h"
+#include "../shapes/triangle_mesh.h"
+#include "test_common.h"
 
 TEST(Groups, Create) {
 auto g = Group();
@@ -210,4 +213,155 @@ EXPECT_EQ(*s1, *(subgroup->child<Group>(0)->child<Sphere>(0)));
 ASSERT_EQ(2, subgroup->child<Group>(1)->size());
 EXPECT_EQ(*s2, *(subgroup->child<Group>(1)->child<Sphere>(0)));
 EXPECT_EQ(*s3, *(subgroup->child<Group>(1)->child<Sphere>(1)));
-}
\ No newline at end of file
+}
+TEST(Groups, CommitCachesWorldMatrices) {
+  auto g1 = Group();
+  g1.set_transform(CreateRotationY(PI_2));
+  auto g2 = Group();
+  g2.set_transform(CreateScaling(1, 2, 3));
+  g1.add(&g2);
+  auto s = Sphere();
+  s.set_transform(CreateTranslation(5, 0, 0));
+  g2.add(&s);
+
+  auto point = Tuple::point(1.7321, 1.1547, -5.5774);
+  auto normal = Tuple::vector(0.3, -0.5, 0.8);
+  auto object_point = s.worldToObject(point);
+  auto world_normal = s.normalToWorld(normal);
+  auto expected = s.normal_at(point);
+  EXPECT_FALSE(s.committed());
+
+  g1.commit();
+  EXPECT_TRUE(s.committed());
+  EXPECT_EQ(object_point, s.worldToObject(point));
+  EXPECT_EQ(world_normal, s.normalToWorld(normal));
+  EXPECT_EQ(expected, s.normal_at(point));
+  EXPECT_EQ(point, s.object_to_world() * object_point);
+
+  // moving any shape drops the caches until the next commit
+  g1.set_transform(CreateTranslation(0, 1, 0));
+  EXPECT_FALSE(s.committed());
+  EXPECT_EQ(Tuple::point(-5, 0, 1), s.worldToObject(Tuple::point(0, 1, 3)));
+  g1.commit();
+  EXPECT_EQ(Tuple::point(-5, 0, 1), s.worldToObject(Tuple::point(0, 1, 3)));
+}
+
+TEST(Groups, CommitFinalizesBounds) {
+  auto g = Group();
+  g.set_transform(CreateTranslation(0, 0, 5));
+  auto s1 = Sphere();
+  s1.set_transform(CreateTranslation(2, 0, 0));
+  g.add(&s1);
+
+  g.commit();
+  auto box = g.bounds_of();
+  EXPECT_EQ(Tuple::point(1, -1, -1), box->min());
+  EXPECT_EQ(Tuple::point(3, 1, 1), box->max());
+  EXPECT_EQ(Tuple::point(1, -1, 4), g.parent_space_bounds_of()->min());
+  // reading a committed group hands back the same, already final, boxes
+  EXPECT_EQ(box, g.bounds_of());
+  EXPECT_TRUE(g.committed());
+
+  // adding a child uncommits the scene and the bounds follow it
+  auto s2 = Sphere();
+  s2.set_transform(CreateTranslation(-4, 0, 0));
+  g.add(&s2);
+  EXPECT_FALSE(g.committed());
+  EXPECT_EQ(Tuple::point(-5, -1, -1), g.bounds_of()->min());
+
+  g.commit();
+  s1.set_transform(CreateTranslation(6, 0, 0));
+  EXPECT_EQ(Tuple::point(7, 1, 1), g.bounds_of(false)->max());
+  EXPECT_EQ(Tuple::point(7, 1, 6), g.parent_space_bounds_of()->max());
+}
+
+TEST(Groups, CommitIsPerScene) {
+  auto g1 = Group();
+  auto s1 = Sphere();
+  g1.add(&s1);
+  auto g2 = Group();
+  auto s2 = Sphere();
+  g2.add(&s2);
+  g1.commit();
+  g2.commit();
+
+  // a change of bounds uncommits the shape and what contains it
+  s2.set_transform(CreateTranslation(1, 0, 0));
+  EXPECT_FALSE(s2.committed());
+  EXPECT_FALSE(g2.committed());
+  // but not another scene
+  EXPECT_TRUE(g1.committed());
+  EXPECT_TRUE(s1.committed());
+
+  // moving a group also uncommits what is below it
+  g2.commit();
+  g1.set_transform(CreateScaling(2, 2, 2));
+  EXPECT_FALSE(s1.committed());
+  EXPECT_TRUE(g2.committed());
+}
+
+namespace {
+// Nested, transformed groups holding one of each kind of leaf.
+struct NestedScene {
+  NestedScene() {
+    outer.set_transform(CreateRotationY(0.4) * CreateScaling(1, 2, 1));
+    inner.set_transform(CreateTranslation(1, 0, -1) * CreateRotationX(0.3));
+    outer.add(&inner);
+    outer.add(&tri);
+    sphere.set_transform(CreateScaling(0.5, 0.5, 0.5));
+    inner.add(&sphere);
+    inner.add(&smooth);
+    for (auto p : {Tuple::point(-1, -1, 2), Tuple::point(1, -1, 2),
+                   Tuple::point(0, 1, 2)}) {
+      mesh.add_vertex(p);
+    }
+    mesh.add_triangle(0, 1, 2);
+    mesh.build();
+    mesh.set_transform(CreateTranslation(0, 0, 1));
+    inner.add(&mesh);
+  }
+
+  Group outer;
+  Group inner;
+  Sphere sphere;
+  Triangle tri{Tuple::point(-2, 0, 3), Tuple::point(2, 0, 3),
+               Tuple::point(0, 2, 3)};
+  SmoothTriangle smooth{Tuple::point(0, 1, 0),  Tuple::point(-1, 0, 0),
+                        Tuple::point(1, 0, 0),  Tuple::vector(0, 1, -1),
+                        Tuple::vector(-1, 0, -1), Tuple::vector(1, 0, -1)};
+  TriangleMesh mesh;
+};
+}  // namespace
+
+TEST(Groups, FlattenKeepsIntersectionsAndNormals) {
+  NestedScene nested, flat;
+  flat.outer.flatten();
+
+  EXPECT_EQ(Matrix(IDENTITY), flat.outer.transform());
+  EXPECT_EQ(Matrix(IDENTITY), flat.inner.transform());
+  EXPECT_EQ(Matrix(IDENTITY), flat.tri.transform());
+  EXPECT_EQ(Matrix(IDENTITY), flat.smooth.transform());
+  EXPECT_EQ(Matrix(IDENTITY), flat.mesh.transform());
+  EXPECT_NE(Matrix(IDENTITY), flat.sphere.transform());
+
+  int hits = 0;
+  for (int i = 0; i < 200; ++i) {
+    auto origin = Tuple::point((i % 7) * 0.4 - 1.3, (i % 5) * 0.5 - 0.9, -6);
+    auto target = Tuple::point((i % 11) * 0.3 - 1.4, (i % 9) * 0.4 - 1.1, 2);
+    auto r = Ray(origin, (target - origin).normalize());
+
+    auto expected = nested.outer.intersects(r);
+    auto xs = flat.outer.intersects(r);
+    ASSERT_EQ(expected.size(), xs.size()) << i;
+    for (size_t j = 0; j < xs.size(); ++j) {
+      // the mesh keeps its baked vertices in float
+      EXPECT_NEAR(expected[j].t(), xs[j].t(),
+                  std::max(1e-6, REAL_TOLERANCE));
+      auto p = r.position(xs[j].t());
+      EXPECT_EQ(expected[j].object()->normal_at(p, &expected[j]),
+                xs[j].object()->normal_at(p, &xs[j]));
+      hits++;
+    }
+  }
+  EXPECT_GT(hits, 50);
+}
@@ -0,0 +1,169 @@
+#include "../shapes/instance.h"
+
+#include "../core/bvh.h"
+#include "../core/camera.h"
+#include "../core/world.h"
+#include "../shapes/sphere.h"
+#include "../shapes/triangle.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace {
+std::shared_ptr<Group> make_prototype(std::vector<std::shared_ptr<Shape>>* owned) {
+  auto proto = std::make_shared<Group>();
+  for (int i = 0; i < 8; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 2.5, 0, 0));
+    proto->add(s.get());
+    owned->push_back(s);
+  }
+  BVHBuilder().build(proto.get());
+  return proto;
+}
+}  // namespace
+
+TEST(Instance, Bounds) {
+  std::vector<std::shared_ptr<Shape>> owned;
+  auto proto = make_prototype(&owned);
+  auto i = Instance(proto);
+  EXPECT_EQ(Tuple::point(-1, -1, -1), i.bounds_of()->min());
+  EXPECT_EQ(Tuple::point(18.5, 1, 1), i.bounds_of()->max());
+  EXPECT_NE(nullptr, proto->linear_bvh());
+}
+
+TEST(Instance, IntersectThroughTransform) {
+  std::vector<std::shared_ptr<Shape>> owned;
+  auto proto = make_prototype(&owned);
+  auto i = Instance(proto);
+  i.set_transform(CreateTranslation(0, 10, 0));
+
+  auto miss = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+  EXPECT_TRUE(i.intersects(miss).empty());
+
+  auto hit = Ray(Tuple::point(0, 10, -5), Tuple::vector(0, 0, 1));
+  auto xs = i.intersects(hit);
+  ASSERT_EQ(2, xs.size());
+  EXPECT_EQ(owned[0].get(), xs[0].object());
+  EXPECT_EQ(&i, xs[0].instance());
+  EXPECT_DOUBLE_EQ(4.0, xs[0].t());
+}
+
+TEST(Instance, NormalUsesInstanceTransform) {
+  auto s = std::make_shared<Sphere>();
+  auto proto = std::make_shared<Group>();
+  proto->add(s.get());
+
+  auto i = Instance(proto);
+  i.set_transform(CreateTranslation(0, 10, 0) * CreateScaling(1, 2, 1));
+
+  auto r = Ray(Tuple::point(0, 10, -5), Tuple::vector(0, 0, 1));
+  auto xs = i.intersects(r);
+  ASSERT_EQ(2, xs.size());
+
+  auto comps = ComputedIntersection(xs[0], r);
+  EXPECT_EQ(Tuple::point(0, 10, -1), comps.point);
+  EXPECT_EQ(Tuple::vector(0, 0, -1), comps.normalv);
+
+  // a point off the equator shows the non-uniform scale in the normal
+  auto r2 = Ray(Tuple::point(0, 11, -5), Tuple::vector(0, 0, 1));
+  auto xs2 = i.intersects(r2);
+  ASSERT_EQ(2, xs2.size());
+  auto comps2 = ComputedIntersection(xs2[0], r2);
+  auto expected = Sphere();
+  expected.set_transform(i.transform());
+  EXPECT_TRUE(vector_is_near(expected.normal_at(comps2.point), comps2.normalv,
+                             EPSILON));
+}
+
+TEST(Instance, WorldTopLevelBVH) {
+  std::vector<std::shared_ptr<Shape>> owned;
+  auto proto = make_prototype(&owned);
+
+  std::vector<std::shared_ptr<Instance>> instances;
+  auto w = World();
+  for (int i = 0; i < 100; ++i) {
+    auto inst = std::make_shared<Instance>(proto);
+    inst->set_transform(CreateTranslation(0, i * 3, 0));
+    w.add(inst.get());
+    instances.push_back(inst);
+  }
+
+  auto r = Ray(Tuple::point(-5, 30, 0), Tuple::vector(1, 0, 0));
+  auto brute = w.intersect(r);
+
+  auto stats = w.build_bvh();
+  EXPECT_EQ(100, stats.primitives);
+
+  auto xs = w.intersect(r);
+  ASSERT_EQ(16, xs.size());
+  ASSERT_EQ(brute.size(), xs.size());
+  for (size_t i = 0; i < xs.size(); ++i) {
+    EXPECT_EQ(brute[i], xs[i]);
+    EXPECT_EQ(instances[10].get(), xs[i].instance());
+  }
+
+  auto comps = ComputedIntersection(xs[0], r);
+  EXPECT_EQ(Tuple::vector(-1, 0, 0), comps.normalv);
+}
+
+TEST(Instance, AddingToWorldInvalidatesBVH) {
+  auto s1 = std::make_shared<Sphere>();
+  auto s2 = std::make_shared<Sphere>();
+  s2->set_transform(CreateTranslation(0, 0, 10));
+  auto w = World();
+  w.add(s1.get());
+  w.build_bvh();
+  EXPECT_NE(nullptr, s1->parent());
+
+  w.add(s2.get());
+  EXPECT_EQ(nullptr, s1->parent());
+  auto r = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+  EXPECT_EQ(4, w.intersect(r).size());
+}
+
+TEST(Instance, HitsThroughDifferentInstancesDiffer) {
+  std::vector<std::shared_ptr<Shape>> owned;
+  auto proto = make_prototype(&owned);
+  auto s = owned.front();
+  auto a = Instance(proto);
+  auto b = Instance(proto);
+  auto direct = Intersection(4, s.get(), 0, 0, 0);
+  auto via_a = direct;
+  via_a.set_instance(&a);
+  auto via_b = direct;
+  via_b.set_instance(&b);
+  EXPECT_EQ(via_a, via_a);
+  EXPECT_FALSE(via_a == via_b);
+  EXPECT_FALSE(via_a == direct);
+  EXPECT_FALSE(direct == Intersection(4, s.get(), 0, 0, 1));
+}
+
+TEST(Instance, ChangingThePrototypeUncommitsTheWorld) {
+  std::vector<std::shared_ptr<Shape>> owned;
+  auto proto = make_prototype(&owned);
+  auto a = Instance(proto);
+  auto b = Instance(proto);
+  b.set_transform(CreateTranslation(0, 3, 0));
+  auto light = PointLight(Tuple::point(-10, 10, -10), Color(1, 1, 1));
+  auto w = World();
+  w.set_light(&light);
+  w.add(&a);
+  w.add(&b);
+  w.build_bvh();
+  w.commit();
+  EXPECT_TRUE(w.committed());
+
+  // nothing links the prototype to its instances, so they ask it
+  owned.back()->set_transform(CreateTranslation(0, 0, 5));
+  EXPECT_FALSE(a.committed());
+  EXPECT_FALSE(w.committed());
+  auto c = Camera(10, 10, PI_2);
+  EXPECT_THROW(c.render(w), std::runtime_error);
+
+  a.refit();
+  b.refit();
+  w.build_bvh();
+  w.commit();
+  EXPECT_TRUE(w.committed());
+  EXPECT_NO_THROW(c.render(w));
+}
@@ -2,6 +2,7 @@
 
 #include "../core/color.h"
 #include "../core/material.h"
+#include "../core/sampler.h"
 #include "../core/tuple.h"
 #include "../core/world.h"
 #include "gtest/gtest.h"
@@ -67,6 +68,20 @@ TEST(AreaLight, PointOn) {
   EXPECT_EQ(Tuple::point(1.75, 0, 0.75), light.point_on(3, 1));
 }
 
+TEST(AreaLight, PointOnFromSampler) {
+  auto light = AreaLight(Tuple::point(0, 0, 0), Tuple::vector(2, 0, 0), 4,
+                         Tuple::vector(0, 0, 1), 2, Color(1, 1, 1));
+  SobolSampler sampler;
+  SampleScope scope(&sampler, 3, 4, 5);
+  auto p = light.point_on(2, 1);
+  EXPECT_EQ(p, light.point_on(2, 1));
+  EXPECT_EQ(light.samples()[1 * 4 + 2], p);
+  EXPECT_GE(p.x, 1.0);
+  EXPECT_LT(p.x, 1.5);
+  EXPECT_GE(p.z, 0.5);
+  EXPECT_LT(p.z, 1.0);
+}
+
 TEST(AreaLight, IntensityAt) {
   auto w = World::default_world();
   auto corner = Tuple::point(-0.5, -0.5, -5);
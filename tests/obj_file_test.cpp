@@ -166,4 +166,25 @@ TEST(ObjectFile, FacesWithNormals) {
   EXPECT_EQ(n[1], t1->n2);
   EXPECT_EQ(n[2], t1->n3);
   EXPECT_EQ(*t1, *t2);
-}
\ No newline at end of file
+}
+TEST(ObjectFile, FacesAsMesh) {
+  std::string file = {
+      "v 0 1 0\n"
+      "v -1 0 0\n"
+      "v 1 0 0\n"
+      "v 0 -1 0\n"
+      "vn -1 0 0\n"
+      "vn 1 0 0\n"
+      "vn 0 1 0\n"
+      "f 1//3 2//1 3//2\n"
+      "f 2 4 3\n"
+  };
+  auto parsed = ObjFile(file, false, /* mesh */ true);
+  auto g = parsed.default_group();
+  ASSERT_EQ(1, g->children().size());
+
+  auto mesh = dynamic_cast<TriangleMesh*>(g->children()[0]);
+  ASSERT_NE(nullptr, mesh);
+  EXPECT_EQ(2, mesh->triangle_count());
+  EXPECT_EQ(2, g->size(/* recurse */ true));
+}
@@ -0,0 +1,197 @@
+#include "../core/ray_packet.h"
+
+#include "../core/bvh.h"
+#include "../core/camera.h"
+#include "../core/world.h"
+#include "../shapes/group.h"
+#include "../shapes/plane.h"
+#include "../shapes/sphere.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+namespace {
+template <size_t N>
+void check_simd() {
+  alignas(64) float a[N], b[N], out[N];
+  for (size_t i = 0; i < N; ++i) {
+    a[i] = i;
+    b[i] = N - i;
+  }
+  a[0] = NAN;
+
+  using F = SimdFloat<N>;
+  auto x = F::load(a);
+  auto y = F::load(b);
+  (x + y).store(out);
+  EXPECT_FLOAT_EQ(N, out[1]);
+  (x * y).store(out);
+  EXPECT_FLOAT_EQ(N - 1, out[1]);
+
+  // NaN lanes give the second operand
+  min(x, y).store(out);
+  EXPECT_FLOAT_EQ(N, out[0]);
+  EXPECT_FLOAT_EQ(1, out[1]);
+  max(y, x).store(out);
+  EXPECT_TRUE(std::isnan(out[0]));
+
+  unsigned expected = 0;
+  for (size_t i = 1; i < N; ++i) {
+    expected |= unsigned(a[i] <= b[i]) << i;
+  }
+  EXPECT_EQ(expected, x <= y);
+}
+
+template <size_t N>
+void check_intersect_matches(World& w, const std::vector<Ray>& rays) {
+  for (size_t begin = 0; begin < rays.size(); begin += N) {
+    auto n = std::min(N, rays.size() - begin);
+    IntersectionVector xs[N];
+    w.intersect<N>(rays.data() + begin, n, xs);
+    for (size_t i = 0; i < n; ++i) {
+      auto expected = w.intersect(rays[begin + i]);
+      ASSERT_EQ(expected.size(), xs[i].size()) << "N = " << N;
+      for (size_t j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(expected[j], xs[i][j]);
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST(RayPacket, Simd) {
+  check_simd<4>();
+  check_simd<8>();
+  check_simd<16>();
+}
+
+TEST(RayPacket, AxisParallelRays) {
+  LinearBVHNode node{};
+  node.min[0] = node.min[1] = node.min[2] = 0;
+  node.max[0] = node.max[1] = node.max[2] = 1;
+  node.count = 1;
+
+  RayPacket<8> p;
+  // along x, on the lower face, on the upper face, inside, and outside
+  p.set(0, Ray(Tuple::point(-5, 0, 0.5), Tuple::vector(1, 0, 0)));
+  p.set(1, Ray(Tuple::point(-5, 1, 0.5), Tuple::vector(1, 0, 0)));
+  p.set(2, Ray(Tuple::point(-5, 0.5, 0.5), Tuple::vector(1, -0.0, 0)));
+  p.set(3, Ray(Tuple::point(-5, 2, 0.5), Tuple::vector(1, 0, 0)));
+  // pointing away, and a range that ends before the box
+  p.set(4, Ray(Tuple::point(-5, 0.5, 0.5), Tuple::vector(-1, 0, 0)), 0);
+  p.set(5, Ray(Tuple::point(-5, 0.5, 0.5), Tuple::vector(1, 0, 0)), 0, 4);
+  EXPECT_EQ(0b000111u, p.intersects(node));
+
+  p.active &= ~1u;
+  EXPECT_EQ(0b000110u, p.intersects(node));
+}
+
+TEST(RayPacket, IntersectMatchesSingleRays) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  auto g = std::make_shared<Group>();
+  for (int i = 0; i < 100; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation((i % 10) - 5, (i / 10) - 5, i % 3) *
+                     CreateScaling(0.4, 0.4, 0.4));
+    g->add(s.get());
+    spheres.push_back(s);
+  }
+  BVHBuilder().build(g.get());
+  g->build_linear_bvh();
+
+  auto floor = std::make_shared<Plane>();
+  floor->set_transform(CreateTranslation(0, -6, 0));
+
+  auto w = World::default_world();
+  w.add(g.get());
+  w.add(floor.get());
+
+  auto c = Camera(23, 17, PI_3);
+  c.set_transform(view_transform(Tuple::point(0, 1, -15), Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  std::vector<Ray> rays;
+  for (int y = 0; y < 17; ++y) {
+    for (int x = 0; x < 23; ++x) {
+      rays.push_back(c.ray_for_pixel(x, y));
+    }
+  }
+  rays.push_back(Ray(Tuple::point(-20, 0, 0), Tuple::vector(1, 0, 0)));
+
+  check_intersect_matches<4>(w, rays);
+  check_intersect_matches<8>(w, rays);
+  check_intersect_matches<16>(w, rays);
+
+  // and through a world-level BVH over the objects
+  w.build_bvh();
+  check_intersect_matches<8>(w, rays);
+}
+
+TEST(RayPacket, OccludedMatchesIsShadowed) {
+  auto w = World::default_world();
+  auto lp = w.light()->position();
+  std::vector<Tuple> points = {
+      Tuple::point(0, 10, 0),    Tuple::point(10, -10, 10),
+      Tuple::point(-20, 20, -20), Tuple::point(-2, 2, -2),
+      Tuple::point(0, 0, 0),     Tuple::point(-10, -10, 10),
+      Tuple::point(10, 10, 10),  Tuple::point(-5, -5, -5),
+  };
+
+  std::optional<Ray> rays[8];
+  double distance[8];
+  unsigned expected = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    auto v = lp - points[i];
+    distance[i] = v.magnitude();
+    rays[i] = Ray(points[i], v.normalize());
+    expected |= unsigned(w.is_shadowed(lp, points[i])) << i;
+  }
+  EXPECT_EQ(expected, w.occluded<8>(rays, distance, points.size()));
+  EXPECT_NE(0u, expected);
+}
+
+TEST(RayPacket, RenderMatchesSingleRays) {
+  auto w = World::default_world();
+  w.commit();
+  auto c = Camera(21, 11, PI_2);
+  c.set_transform(view_transform(Tuple::point(0, 0, -5), Tuple::point(0, 0, 0),
+                                 Tuple::vector(0, 1, 0)));
+  c.set_packet_size(1);
+  auto expected = c.render(w);
+
+  for (size_t n : {4, 8, 16}) {
+    c.set_packet_size(n);
+    auto image = c.render(w);
+    for (int y = 0; y < 10; ++y) {
+      for (int x = 0; x < 20; ++x) {
+        EXPECT_EQ(expected.pixel_at(x, y), image.pixel_at(x, y))
+            << x << ", " << y << " with packets of " << n;
+      }
+    }
+  }
+  EXPECT_THROW(c.set_packet_size(3), std::runtime_error);
+}
+
+TEST(RayPacket, DeeperThanTraversalStack) {
+  std::vector<std::shared_ptr<Sphere>> spheres;
+  std::vector<std::shared_ptr<Group>> groups;
+  groups.push_back(std::make_shared<Group>());
+  for (int i = 0; i < 1000; ++i) {
+    auto s = std::make_shared<Sphere>();
+    s->set_transform(CreateTranslation(i * 3, 0, 0));
+    groups.back()->add(s.get());
+    spheres.push_back(s);
+    auto sub = std::make_shared<Group>();
+    groups.back()->add(sub.get());
+    groups.push_back(sub);
+  }
+  groups.front()->build_linear_bvh();
+
+  auto w = World();
+  w.add(groups.front().get());
+  std::vector<Ray> rays;
+  for (int i = 0; i < 8; ++i) {
+    rays.push_back(Ray(Tuple::point(-10, i * 0.1, 0), Tuple::vector(1, 0, 0)));
+    rays.push_back(
+        Ray(Tuple::point(3010, 0, i * 0.1), Tuple::vector(-1, 0, 0)));
+  }
+  check_intersect_matches<8>(w, rays);
+}
@@ -0,0 +1,37 @@
+#include "../core/rng.h"
+
+#include "gtest/gtest.h"
+
+TEST(Pcg32, ReferenceOutput) {
+  // pcg32_srandom_r(&rng, 42, 54) in the PCG reference implementation
+  Pcg32 rng(42, 54);
+  for (uint32_t expected : {0xa15c02b7u, 0x7b47f409u, 0xba1d3330u, 0x83d2f293u,
+                            0xbfa4784bu, 0xcbed606eu}) {
+    EXPECT_EQ(expected, rng.next());
+  }
+}
+
+TEST(Pcg32, Advance) {
+  Pcg32 a(7, 3);
+  Pcg32 b(7, 3);
+  for (int i = 0; i < 1000; ++i) {
+    a.next();
+  }
+  b.advance(1000);
+  EXPECT_EQ(a.next(), b.next());
+
+  Pcg32 other_stream(7, 4);
+  EXPECT_NE(Pcg32(7, 3).next(), other_stream.next());
+}
+
+TEST(Pcg32, NextDouble) {
+  Pcg32 rng(1, 1);
+  double total = 0.0;
+  for (int i = 0; i < 10000; ++i) {
+    auto v = rng.next_double();
+    ASSERT_GE(v, 0.0);
+    ASSERT_LT(v, 1.0);
+    total += v;
+  }
+  EXPECT_NEAR(0.5, total / 10000, 0.01);
+}
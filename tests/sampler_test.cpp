@@ -0,0 +1,137 @@
+#include "../core/sampler.h"
+
+#include <cmath>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+const std::vector<std::string> SAMPLERS = {"random", "stratified", "halton",
+                                           "sobol", "bluenoise"};
+
+// RMS error over many pixels of estimating the area of the quarter disc
+// with `samples` points per pixel.
+double disc_error(const Sampler& s, size_t samples) {
+  double total = 0.0;
+  const uint32_t pixels = 256;
+  for (uint32_t p = 0; p < pixels; ++p) {
+    size_t inside = 0;
+    for (size_t i = 0; i < samples; ++i) {
+      auto u = s.get(p % 16, p / 16, i, SampleDimension::PIXEL_X);
+      auto v = s.get(p % 16, p / 16, i, SampleDimension::PIXEL_Y);
+      inside += u * u + v * v < 1;
+    }
+    auto error = double(inside) / samples - M_PI / 4;
+    total += error * error;
+  }
+  return std::sqrt(total / pixels);
+}
+}  // namespace
+
+TEST(Sampler, InUnitInterval) {
+  for (const auto& name : SAMPLERS) {
+    auto s = make_sampler(name, 16);
+    for (uint64_t i = 0; i < 100; ++i) {
+      for (auto d : {SampleDimension::PIXEL_X, SampleDimension::PIXEL_Y,
+                     SampleDimension::LIGHT_U, SampleDimension::LENS_V}) {
+        auto v = s->get(i % 7, i % 5, i, d);
+        ASSERT_GE(v, 0.0) << name;
+        ASSERT_LT(v, 1.0) << name;
+      }
+    }
+  }
+  EXPECT_THROW(make_sampler("poisson", 16), std::runtime_error);
+}
+
+TEST(Sampler, Deterministic) {
+  for (const auto& name : SAMPLERS) {
+    auto s = make_sampler(name, 16);
+    EXPECT_EQ(s->get(3, 4, 5, SampleDimension::LIGHT_V),
+              s->get(3, 4, 5, SampleDimension::LIGHT_V))
+        << name;
+    EXPECT_NE(s->get(3, 4, 5, SampleDimension::LIGHT_V),
+              s->get(4, 3, 5, SampleDimension::LIGHT_V))
+        << name;
+    EXPECT_NE(s->get(3, 4, 5, SampleDimension::LIGHT_V),
+              make_sampler(name, 16, 1)->get(3, 4, 5, SampleDimension::LIGHT_V))
+        << name;
+  }
+}
+
+TEST(Sampler, StratifiedCoversEveryCell) {
+  StratifiedSampler s(16);
+  for (auto d : {SampleDimension::PIXEL_X, SampleDimension::LIGHT_U}) {
+    auto other = static_cast<SampleDimension>(static_cast<uint32_t>(d) + 1);
+    std::set<int> cells;
+    for (uint64_t i = 0; i < 16; ++i) {
+      int x = s.get(5, 9, i, d) * 4;
+      int y = s.get(5, 9, i, other) * 4;
+      cells.insert(y * 4 + x);
+    }
+    EXPECT_EQ(16, cells.size());
+  }
+}
+
+TEST(Sampler, SobolElementaryIntervals) {
+  SobolSampler s;
+  // 32 points put one in every 2^a x 2^(5-a) box
+  for (int a = 0; a <= 5; ++a) {
+    std::set<int> boxes;
+    for (uint64_t i = 0; i < 32; ++i) {
+      int x = s.get(2, 7, i, SampleDimension::LIGHT_U) * (1 << a);
+      int y = s.get(2, 7, i, SampleDimension::LIGHT_V) * (1 << (5 - a));
+      boxes.insert(y * 32 + x);
+    }
+    EXPECT_EQ(32, boxes.size()) << a;
+  }
+}
+
+TEST(Sampler, ConvergesFasterThanRandom) {
+  RandomSampler random;
+  auto baseline = disc_error(random, 64);
+  for (const auto& name : SAMPLERS) {
+    if (name != "random") {
+      EXPECT_LT(disc_error(*make_sampler(name, 64), 64) * 2, baseline) << name;
+    }
+  }
+}
+
+TEST(Sampler, BlueNoiseMask) {
+  const int n = BLUE_NOISE_SIZE;
+  std::set<double> values;
+  double blurred = 0.0;
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      values.insert(blue_noise(x, y));
+      // a 3 x 3 box filter keeps only the low frequencies
+      double mean = 0.0;
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          mean += blue_noise(x + dx + n, y + dy + n) / 9;
+        }
+      }
+      blurred += (mean - 0.5) * (mean - 0.5);
+    }
+  }
+  EXPECT_EQ(n * n, values.size());
+  EXPECT_EQ(blue_noise(3, 5), blue_noise(3 + n, 5));
+  // white noise would leave a variance of 1/12 / 9
+  EXPECT_LT(blurred / values.size(), 1.0 / 12 / 9 / 3);
+}
+
+TEST(Sampler, Scope) {
+  SobolSampler s;
+  EXPECT_EQ(nullptr, current_sample().sampler);
+  {
+    SampleScope outer(&s, 1, 2, 3);
+    {
+      SampleScope inner(&s, 4, 5, 6);
+      EXPECT_EQ(6, current_sample().index);
+    }
+    EXPECT_EQ(&s, current_sample().sampler);
+    EXPECT_EQ(1, current_sample().x);
+    EXPECT_EQ(3, current_sample().index);
+  }
+  EXPECT_EQ(nullptr, current_sample().sampler);
+}
@@ -0,0 +1,213 @@
+#include "../shapes/sphere_set.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "../core/bvh.h"
+#include "../shapes/group.h"
+#include "../shapes/sphere.h"
+#include "test_common.h"
+#include "gtest/gtest.h"
+
+namespace {
+// An n x n x n lattice of jittered particles, as a set and as Spheres.
+struct Particles {
+  explicit Particles(int n) {
+    for (int k = 0; k < n; ++k) {
+      for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i) {
+          // multiples of 1/64, so the float centers are exact
+          auto jitter = [](int a) { return ((a * 37) % 16) / 64.0; };
+          auto center = Tuple::point(i - n / 2.0 + jitter(i + j),
+                                     j - n / 2.0 + jitter(j + k),
+                                     k - n / 2.0 + jitter(k + i));
+          auto radius = 0.125 + ((i + j + k) % 4) / 16.0;
+          set.add_sphere(center, radius);
+          auto s = std::make_shared<Sphere>();
+          s->set_transform(CreateTranslation(center.x, center.y, center.z) *
+                           CreateScaling(radius, radius, radius));
+          group.add(s.get());
+          spheres.push_back(s);
+        }
+      }
+    }
+    BVHBuilder().build(&group);
+    group.build_linear_bvh();
+    set.build();
+  }
+
+  Ray ray(int i) const {
+    auto origin = Tuple::point((i % 13) - 6.3, 9, (i % 7) - 3.1);
+    auto target = Tuple::point((i % 11) - 5.2, -4, (i % 9) - 4.3);
+    return Ray(origin, (target - origin).normalize());
+  }
+
+  SphereSet set;
+  Group group;
+  std::vector<std::shared_ptr<Sphere>> spheres;
+};
+}  // namespace
+
+TEST(SphereSet, Create) {
+  SphereSet s;
+  s.add_sphere(Tuple::point(1, 2, 3), 0.5);
+  s.add_sphere(Tuple::point(-1, 0, 0), 1);
+  EXPECT_EQ(2, s.sphere_count());
+  EXPECT_EQ(Tuple::point(-2, -1, -1), s.bounds_of()->min());
+  EXPECT_EQ(Tuple::point(1.5, 2.5, 3.5), s.bounds_of()->max());
+
+  auto r = Ray(Tuple::point(1, 2, -5), Tuple::vector(0, 0, 1));
+  auto hit = s.closest_hit(r, 0, INFINITY);
+  ASSERT_TRUE(hit.has_value());
+  EXPECT_DOUBLE_EQ(7.5, hit->t());
+  EXPECT_EQ(0, hit->index());
+  EXPECT_EQ(Tuple::vector(0, 0, -1),
+            s.normal_at(r.position(hit->t()), &*hit));
+  EXPECT_THROW(s.normal_at(r.position(hit->t())), std::runtime_error);
+}
+
+TEST(SphereSet, BadSphere) {
+  SphereSet s;
+  EXPECT_THROW(s.add_sphere(Tuple::point(0, 0, 0), 1, 0), std::runtime_error);
+  EXPECT_THROW(s.add_sphere(Tuple::point(0, 0, 0), 0), std::runtime_error);
+}
+
+TEST(SphereSet, Materials) {
+  SphereSet s;
+  s.material()->set_reflective(0.25);
+  Material glass;
+  glass.set_transparency(1.0);
+  auto m = s.add_material(glass);
+  s.add_sphere(Tuple::point(0, 0, 0), 1);
+  s.add_sphere(Tuple::point(0, 0, 4), 1, m);
+  s.build();
+
+  auto r = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+  auto near = s.closest_hit(r, 0, INFINITY);
+  auto far = s.closest_hit(r, 7, INFINITY);
+  ASSERT_TRUE(near.has_value());
+  ASSERT_TRUE(far.has_value());
+  EXPECT_EQ(s.material(), s.material_at(*near));
+  EXPECT_DOUBLE_EQ(1.0, s.material_at(*far)->transparency());
+  EXPECT_EQ(s.material_at(*far), ComputedIntersection(*far, r).material);
+}
+
+TEST(SphereSet, MatchesSpheres) {
+  Particles particles(6);
+  for (int i = 0; i < 300; ++i) {
+    auto r = particles.ray(i);
+
+    auto expected = particles.group.intersects(r);
+    auto xs = particles.set.intersects(r);
+    ASSERT_EQ(expected.size(), xs.size()) << i;
+    for (size_t j = 0; j < xs.size(); ++j) {
+      EXPECT_NEAR(expected[j].t(), xs[j].t(), 1e-6);
+    }
+
+    auto want = particles.group.closest_hit(r, 0, INFINITY);
+    auto hit = particles.set.closest_hit(r, 0, INFINITY);
+    ASSERT_EQ(want.has_value(), hit.has_value()) << i;
+    if (hit) {
+      EXPECT_NEAR(want->t(), hit->t(), 1e-6);
+      auto p = r.position(hit->t());
+      auto want_normal = want->object()->normal_at(p, &*want);
+      auto normal = particles.set.normal_at(p, &*hit);
+      EXPECT_NEAR(want_normal.x, normal.x, 1e-6);
+      EXPECT_NEAR(want_normal.y, normal.y, 1e-6);
+      EXPECT_NEAR(want_normal.z, normal.z, 1e-6);
+    }
+
+    EXPECT_EQ(particles.group.occluded(r, 0, 8),
+              particles.set.occluded(r, 0, 8))
+        << i;
+  }
+}
+
+TEST(SphereSet, UnbuiltSetTestsEverySphere) {
+  SphereSet s;
+  s.add_sphere(Tuple::point(0, 0, 0), 1);
+  EXPECT_TRUE(s.nodes().empty());
+
+  auto r = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+  auto xs = s.intersects(r);
+  ASSERT_EQ(2, xs.size());
+  EXPECT_DOUBLE_EQ(4, xs[0].t());
+  EXPECT_DOUBLE_EQ(6, xs[1].t());
+}
+
+TEST(SphereSet, BlocksCoverEverySphere) {
+  Particles particles(5);
+  const auto& set = particles.set;
+  std::vector<int> seen(set.sphere_count(), 0);
+  for (const auto& node : set.nodes()) {
+    if (!node.leaf()) {
+      continue;
+    }
+    for (uint32_t b = node.offset; b < node.offset + node.count; ++b) {
+      const auto& block = set.blocks()[b];
+      ASSERT_GT(block.count, 0);
+      ASSERT_LE(block.count, SPHERE_BLOCK_WIDTH);
+      for (uint32_t lane = 0; lane < block.count; ++lane) {
+        auto s = block.first + lane;
+        seen[s]++;
+        EXPECT_FLOAT_EQ(set.center(s).x, block.center[0][lane]);
+        EXPECT_FLOAT_EQ(set.radius(s), block.radius[lane]);
+      }
+    }
+  }
+  for (auto n : seen) {
+    EXPECT_EQ(1, n);
+  }
+}
+
+TEST(SphereSet, BakeTransform) {
+  SphereSet s;
+  s.add_sphere(Tuple::point(1, 0, 0), 0.5);
+  s.build();
+  s.bake_transform(CreateTranslation(0, 1, 0) * CreateRotationZ(PI_2) *
+                   CreateScaling(2, 2, 2));
+  EXPECT_EQ(Matrix(IDENTITY), s.transform());
+  EXPECT_EQ(Tuple::point(0, 3, 0), s.center(0));
+  EXPECT_DOUBLE_EQ(1, s.radius(0));
+  EXPECT_FALSE(s.nodes().empty());
+
+  // squashed spheres keep the transform
+  s.bake_transform(CreateScaling(1, 2, 1));
+  EXPECT_EQ(CreateScaling(1, 2, 1), s.transform());
+  EXPECT_EQ(Tuple::point(0, 3, 0), s.center(0));
+}
+
+TEST(SphereSet, SmallerThanSpheres) {
+  Particles particles(8);
+  auto per_sphere =
+      double(particles.set.memory_bytes()) / particles.set.sphere_count();
+  EXPECT_LT(per_sphere * 10, sizeof(Sphere));
+}
+
+TEST(SphereSet, RefractionThroughOverlappingSpheres) {
+  // Sphere.FindingN1andN2 with the three spheres in one set
+  SphereSet s;
+  auto glass = [&s](double refractive) {
+    Material m;
+    m.set_transparency(1.0);
+    m.set_refractive(refractive);
+    return s.add_material(m);
+  };
+  s.add_sphere(Tuple::point(0, 0, 0), 2, glass(1.5));
+  s.add_sphere(Tuple::point(0, 0, -0.25), 1, glass(2.0));
+  s.add_sphere(Tuple::point(0, 0, 0.25), 1, glass(2.5));
+  s.build();
+
+  auto r = Ray(Tuple::point(0, 0, -4), Tuple::vector(0, 0, 1));
+  auto xs = s.intersects(r);
+  std::sort(xs.begin(), xs.end(),
+            [](const auto& a, const auto& b) { return a.t() < b.t(); });
+  ASSERT_EQ(6, xs.size());
+  double n1[] = {1.0, 1.5, 2.0, 2.5, 2.5, 1.5};
+  double n2[] = {1.5, 2.0, 2.5, 2.5, 1.5, 1.0};
+  for (int i = 0; i < 6; ++i) {
+    auto comps = ComputedIntersection(xs[i], r, xs);
+    EXPECT_DOUBLE_EQ(n1[i], comps.n1) << i;
+    EXPECT_DOUBLE_EQ(n2[i], comps.n2) << i;
+  }
+}
@@ -8,6 +8,11 @@
 
 #include "../core/matrix.h"
 #include "../core/tuple.h"
+#include "../core/vec3.h"
+
+// For checking the Real ray math against double references; looser when
+// the build traces in single precision.
+constexpr double REAL_TOLERANCE = sizeof(Real) == sizeof(float) ? 1e-4 : 1e-9;
 
 bool vector_is_near(Tuple a, Tuple b, double abs);
 bool tuple_is_near(Tuple a, Tuple b);
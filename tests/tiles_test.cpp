@@ -0,0 +1,90 @@
+#include "../core/tiles.h"
+
+#include <atomic>
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+namespace {
+// How many tiles cover each pixel.
+std::vector<int> coverage(const std::vector<Tile>& tiles, size_t width,
+                          size_t height) {
+  std::vector<int> out(width * height, 0);
+  for (const auto& t : tiles) {
+    for (auto y = t.y0; y < t.y1; ++y) {
+      for (auto x = t.x0; x < t.x1; ++x) {
+        out[y * width + x]++;
+      }
+    }
+  }
+  return out;
+}
+}  // namespace
+
+TEST(Tiles, CoverImage) {
+  for (auto order : {TileOrder::SCANLINE, TileOrder::MORTON, TileOrder::HILBERT}) {
+    auto tiles = make_tiles(100, 37, 16, order);
+    EXPECT_EQ(7 * 3, tiles.size());
+    for (auto n : coverage(tiles, 100, 37)) {
+      ASSERT_EQ(1, n);
+    }
+  }
+  EXPECT_THROW(make_tiles(10, 10, 0, TileOrder::SCANLINE), std::runtime_error);
+}
+
+TEST(Tiles, Scanline) {
+  auto tiles = make_tiles(64, 64, 16, TileOrder::SCANLINE);
+  EXPECT_EQ(0, tiles[0].x0);
+  EXPECT_EQ(16, tiles[1].x0);
+  EXPECT_EQ(0, tiles[4].x0);
+  EXPECT_EQ(16, tiles[4].y0);
+}
+
+TEST(Tiles, MortonVisitsQuadrants) {
+  auto tiles = make_tiles(64, 64, 16, TileOrder::MORTON);
+  // the first four tiles are the top-left 2x2 block
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_LT(tiles[i].x0, 32);
+    EXPECT_LT(tiles[i].y0, 32);
+  }
+}
+
+TEST(Tiles, HilbertNeverJumps) {
+  auto tiles = make_tiles(256, 256, 16, TileOrder::HILBERT);
+  ASSERT_EQ(256, tiles.size());
+  for (size_t i = 1; i < tiles.size(); ++i) {
+    auto dx = std::abs(int(tiles[i].x0) - int(tiles[i - 1].x0));
+    auto dy = std::abs(int(tiles[i].y0) - int(tiles[i - 1].y0));
+    EXPECT_EQ(16, dx + dy) << i;
+  }
+}
+
+TEST(Tiles, OrderFromName) {
+  EXPECT_EQ(TileOrder::SCANLINE, tile_order_from("scanline"));
+  EXPECT_EQ(TileOrder::MORTON, tile_order_from("morton"));
+  EXPECT_EQ(TileOrder::HILBERT, tile_order_from("hilbert"));
+  EXPECT_THROW(tile_order_from("spiral"), std::runtime_error);
+}
+
+TEST(Tiles, RunVisitsEveryTileOnce) {
+  auto tiles = make_tiles(50, 40, 8, TileOrder::HILBERT);
+  std::vector<std::atomic<int>> visits(tiles.size());
+  auto stats = run_tiles(tiles, 4, [&](const Tile& t) {
+    for (size_t i = 0; i < tiles.size(); ++i) {
+      if (tiles[i].x0 == t.x0 && tiles[i].y0 == t.y0) {
+        visits[i]++;
+      }
+    }
+  });
+  for (const auto& v : visits) {
+    EXPECT_EQ(1, v.load());
+  }
+  ASSERT_EQ(tiles.size(), stats.tiles.size());
+  EXPECT_LE(stats.threads, 4);
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    EXPECT_EQ(tiles[i].x0, stats.tiles[i].tile.x0);
+    EXPECT_GE(stats.tiles[i].millis, 0.0);
+    EXPECT_GE(stats.tiles[i].thread, 0);
+    EXPECT_LT(size_t(stats.tiles[i].thread), stats.threads);
+  }
+}
@@ -0,0 +1,228 @@
+#include "../shapes/triangle_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "../core/bvh.h"
+#include "../shapes/group.h"
+#include "../shapes/triangle.h"
+#include "gtest/gtest.h"
+
+namespace {
+// A bumpy n x n height field, as a mesh and as individual triangles.
+struct Terrain {
+  explicit Terrain(int n, const Tuple& offset = Tuple::vector(0, 0, 0))
+      : offset(offset) {
+    auto height = [](int i, int j) {
+      return std::sin(i * 0.7) * std::cos(j * 0.3);
+    };
+    for (int j = 0; j <= n; ++j) {
+      for (int i = 0; i <= n; ++i) {
+        mesh.add_vertex(
+            Tuple::point(i - n / 2.0, height(i, j), j - n / 2.0) + offset);
+      }
+    }
+    auto at = [&](int i, int j) { return uint32_t(j * (n + 1) + i); };
+    for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < n; ++i) {
+        add(at(i, j), at(i + 1, j), at(i + 1, j + 1));
+        add(at(i, j), at(i + 1, j + 1), at(i, j + 1));
+      }
+    }
+    BVHBuilder().build(&group);
+    group.build_linear_bvh();
+    mesh.build();
+  }
+
+  void add(uint32_t a, uint32_t b, uint32_t c) {
+    mesh.add_triangle(a, b, c);
+    auto t = std::make_shared<Triangle>(mesh.vertex(a), mesh.vertex(b),
+                                        mesh.vertex(c));
+    group.add(t.get());
+    triangles.push_back(t);
+  }
+
+  Ray ray(int i) const {
+    // off the grid lines, so no ray runs through an edge shared by two
+    // triangles
+    auto origin = Tuple::point((i % 13) - 5.63, 5, (i % 7) - 2.71);
+    auto target = Tuple::point((i % 11) - 4.87, -1, (i % 9) - 3.59);
+    return Ray(origin + offset, (target - origin).normalize());
+  }
+
+  Tuple offset;
+  TriangleMesh mesh;
+  Group group;
+  std::vector<std::shared_ptr<Triangle>> triangles;
+};
+}  // namespace
+
+TEST(TriangleMesh, Create) {
+  TriangleMesh m;
+  auto a = m.add_vertex(Tuple::point(0, 1, 0));
+  auto b = m.add_vertex(Tuple::point(-1, 0, 0));
+  auto c = m.add_vertex(Tuple::point(1, 0, 0));
+  m.add_triangle(a, b, c);
+  EXPECT_EQ(1, m.triangle_count());
+  EXPECT_EQ(3, m.vertex_count());
+  EXPECT_EQ(Tuple::point(-1, 0, 0), m.bounds_of()->min());
+  EXPECT_EQ(Tuple::point(1, 1, 0), m.bounds_of()->max());
+  auto hit = Intersection(1, &m, 0, 0, 0);
+  EXPECT_EQ(Tuple::vector(0, 0, -1),
+            m.local_normal_at(Tuple::point(0, 0.5, 0), &hit));
+  EXPECT_THROW(m.local_normal_at(Tuple::point(0, 0.5, 0), nullptr),
+               std::runtime_error);
+}
+
+TEST(TriangleMesh, IndexOutOfRange) {
+  TriangleMesh m;
+  m.add_vertex(Tuple::point(0, 1, 0));
+  m.add_vertex(Tuple::point(-1, 0, 0));
+  m.add_vertex(Tuple::point(1, 0, 0));
+  EXPECT_THROW(m.add_triangle(0, 1, 3), std::runtime_error);
+  EXPECT_THROW(m.add_triangle(0, 1, 2, 0, 0, 0), std::runtime_error);
+}
+
+TEST(TriangleMesh, SmoothNormals) {
+  TriangleMesh m;
+  auto p1 = Tuple::point(0, 1, 0);
+  auto p2 = Tuple::point(-1, 0, 0);
+  auto p3 = Tuple::point(1, 0, 0);
+  auto n1 = Tuple::vector(0, 1, 0);
+  auto n2 = Tuple::vector(-1, 0, 0);
+  auto n3 = Tuple::vector(1, 0, 0);
+  m.add_vertex(p1);
+  m.add_vertex(p2);
+  m.add_vertex(p3);
+  m.add_normal(n1);
+  m.add_normal(n2);
+  m.add_normal(n3);
+  m.add_triangle(0, 1, 2, 0, 1, 2);
+  m.build();
+
+  auto smooth = SmoothTriangle(p1, p2, p3, n1, n2, n3);
+  auto r = Ray(Tuple::point(-0.2, 0.3, -2), Tuple::vector(0, 0, 1));
+  auto hit = m.closest_hit(r, 0, INFINITY);
+  auto expected = smooth.closest_hit(r, 0, INFINITY);
+  ASSERT_TRUE(hit.has_value());
+  ASSERT_TRUE(expected.has_value());
+  EXPECT_DOUBLE_EQ(expected->t(), hit->t());
+  EXPECT_EQ(smooth.normal_at(r.position(hit->t()), &*expected),
+            m.normal_at(r.position(hit->t()), &*hit));
+}
+
+namespace {
+void check_matches_triangles(Terrain& terrain,
+                             const std::function<Ray(int)>& ray) {
+  for (int i = 0; i < 300; ++i) {
+    auto r = ray(i);
+
+    auto expected = terrain.group.intersects(r);
+    auto xs = terrain.mesh.intersects(r);
+    ASSERT_EQ(expected.size(), xs.size()) << i;
+    for (size_t j = 0; j < xs.size(); ++j) {
+      EXPECT_EQ(expected[j].t(), xs[j].t());
+    }
+
+    auto want = terrain.group.closest_hit(r, 0, INFINITY);
+    auto hit = terrain.mesh.closest_hit(r, 0, INFINITY);
+    ASSERT_EQ(want.has_value(), hit.has_value()) << i;
+    if (hit) {
+      EXPECT_EQ(want->t(), hit->t());
+      // through an edge or a vertex, any of the triangles meeting there
+      // may be the one returned
+      auto p = r.position(hit->t());
+      auto n = terrain.mesh.normal_at(p, &*hit);
+      EXPECT_TRUE(std::any_of(expected.begin(), expected.end(),
+                              [&](const Intersection& x) {
+                                return x.t() == hit->t() &&
+                                       x.object()->normal_at(p, &x) == n;
+                              }))
+          << i;
+    }
+
+    EXPECT_EQ(terrain.group.occluded(r, 0, 6),
+              terrain.mesh.occluded(r, 0, 6))
+        << i;
+  }
+}
+}  // namespace
+
+TEST(TriangleMesh, MatchesTriangles) {
+  Terrain terrain(16);
+  check_matches_triangles(terrain, [&](int i) { return terrain.ray(i); });
+}
+
+TEST(TriangleMesh, MatchesTrianglesFarFromOrigin) {
+  // the float kernel's rounding grows with the coordinates; it must still
+  // keep every triangle the exact test hits
+  Terrain terrain(16, Tuple::vector(3.0e4, -2.0e4, 5.0e4));
+  check_matches_triangles(terrain, [&](int i) { return terrain.ray(i); });
+
+  // rays aimed at points on the edges, where a triangle is kept or
+  // dropped on the last bits
+  check_matches_triangles(terrain, [&](int i) {
+    auto a = terrain.mesh.vertex(i % 250);
+    auto b = terrain.mesh.vertex(i % 250 + 1 + (i % 3) * 16);
+    auto target = a + (b - a) * ((i % 7 + 1) / 8.0);
+    auto origin = target + Tuple::vector((i % 5) - 2.1, 4, (i % 3) - 1.3);
+    return Ray(origin, (target - origin).normalize());
+  });
+
+  // and rays that only just graze the surface
+  check_matches_triangles(terrain, [&](int i) {
+    auto origin = Tuple::point(-9, 1.5, (i % 17) - 8.3) + terrain.offset;
+    auto direction = Tuple::vector(1, -0.02 - (i % 5) * 0.01, (i % 3) * 0.001);
+    return Ray(origin, direction.normalize());
+  });
+}
+
+TEST(TriangleMesh, UnbuiltMeshTestsEveryTriangle) {
+  TriangleMesh m;
+  m.add_vertex(Tuple::point(0, 1, 0));
+  m.add_vertex(Tuple::point(-1, 0, 0));
+  m.add_vertex(Tuple::point(1, 0, 0));
+  m.add_triangle(0, 1, 2);
+  EXPECT_TRUE(m.nodes().empty());
+
+  auto r = Ray(Tuple::point(0, 0.5, -2), Tuple::vector(0, 0, 1));
+  auto xs = m.intersects(r);
+  ASSERT_EQ(1, xs.size());
+  EXPECT_DOUBLE_EQ(2, xs[0].t());
+}
+
+TEST(TriangleMesh, BlocksCoverEveryTriangle) {
+  Terrain terrain(16);
+  const auto& blocks = terrain.mesh.blocks();
+  std::vector<int> seen(terrain.mesh.triangle_count(), 0);
+  for (const auto& node : terrain.mesh.nodes()) {
+    if (!node.leaf()) {
+      continue;
+    }
+    for (uint32_t b = node.offset; b < node.offset + node.count; ++b) {
+      ASSERT_LT(b, blocks.size());
+      ASSERT_GT(blocks[b].count, 0);
+      ASSERT_LE(blocks[b].count, TRIANGLE_BLOCK_WIDTH);
+      for (uint32_t lane = 0; lane < blocks[b].count; ++lane) {
+        auto tri = blocks[b].first + lane;
+        seen[tri]++;
+        auto p1 = terrain.mesh.vertex(terrain.mesh.triangle(tri)[0]);
+        EXPECT_FLOAT_EQ(p1.x, blocks[b].p1[0][lane]);
+        EXPECT_FLOAT_EQ(p1.z, blocks[b].p1[2][lane]);
+      }
+    }
+  }
+  for (auto n : seen) {
+    EXPECT_EQ(1, n);
+  }
+}
+
+TEST(TriangleMesh, SmallerThanTriangles) {
+  Terrain terrain(32);
+  auto per_triangle =
+      double(terrain.mesh.memory_bytes()) / terrain.mesh.triangle_count();
+  // the SIMD blocks hold a float copy of every triangle's edges, which
+  // about triples the footprint of the shared buffers alone
+  EXPECT_LT(per_triangle * 5, sizeof(Triangle));
+}
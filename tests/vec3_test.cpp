@@ -0,0 +1,52 @@
+#include "../core/vec3.h"
+
+#include "../core/matrix.h"
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+TEST(Vec3, Compact) {
+  EXPECT_EQ(3 * sizeof(Real), sizeof(Vec3));
+  EXPECT_EQ(3 * sizeof(Real), sizeof(Point3));
+  EXPECT_EQ(3 * sizeof(float), sizeof(Vec3f));
+}
+
+TEST(Vec3, PointArithmetic) {
+  const Point3 p(3, 2, 1);
+  const Point3 q(5, 6, 7);
+  const Vec3 v(1, 1, 1);
+
+  EXPECT_EQ(Vec3(-2, -4, -6), p - q);
+  EXPECT_EQ(Point3(4, 3, 2), p + v);
+  EXPECT_EQ(Point3(2, 1, 0), p - v);
+}
+
+TEST(Vec3, MatchesTuple) {
+  const Vec3 a(1, 2, 3);
+  const Vec3 b(2, 3, 4);
+  const auto ta = Tuple::vector(1, 2, 3);
+  const auto tb = Tuple::vector(2, 3, 4);
+
+  EXPECT_NEAR(dot(ta, tb), dot(a, b), REAL_TOLERANCE);
+  EXPECT_EQ(cross(ta, tb), Tuple(cross(a, b)));
+  EXPECT_NEAR(ta.magnitude(), a.magnitude(), REAL_TOLERANCE);
+  EXPECT_EQ(ta.normalize(), Tuple(a.normalize()));
+
+  const Vec3 n(SQRT2_2, SQRT2_2, 0);
+  EXPECT_EQ(Vec3(1, 0, 0), Vec3(0, -1, 0).reflect(n));
+}
+
+TEST(Vec3, Conversions) {
+  // the type carries what w used to
+  EXPECT_EQ(Tuple::point(1, 2, 3), Tuple(Point3(1, 2, 3)));
+  EXPECT_EQ(Tuple::vector(1, 2, 3), Tuple(Vec3(1, 2, 3)));
+  EXPECT_EQ(Tuple::vector(1, 2, 3), Tuple(Normal3(1, 2, 3)));
+  EXPECT_EQ(Point3(1, 2, 3), Point3(Tuple::point(1, 2, 3)));
+}
+
+TEST(Vec3, Transform) {
+  auto m = CreateTranslation(5, -3, 2) * CreateRotationY(PI_4) *
+           CreateScaling(2, 3, 4);
+
+  EXPECT_EQ(m * Tuple::point(-3, 4, 5), Tuple(m * Point3(-3, 4, 5)));
+  EXPECT_EQ(m * Tuple::vector(-3, 4, 5), Tuple(m * Vec3(-3, 4, 5)));
+}
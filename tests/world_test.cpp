@@ -6,8 +6,10 @@
 #include "../core/light.h"
 #include "../core/material.h"
 #include "../core/tuple.h"
+#include "../shapes/cube.h"
 #include "../shapes/plane.h"
 #include "../shapes/sphere.h"
+#include "../shapes/triangle.h"
 #include "gtest/gtest.h"
 #include "test_common.h"
 
@@ -460,3 +462,162 @@ TEST(Refract, ShadeHitWIthReflectiveAndTransParent) {
   auto color = w.shade_hit(comps, 5);
   EXPECT_EQ(Color(0.93391, 0.69643, 0.69243), color);
 }
+
+TEST(World, OccludedIsAnyHit) {
+  auto w = World::default_world();
+  auto r = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+
+  EXPECT_TRUE(w.occluded(r, 10));
+  EXPECT_TRUE(w.occluded(r, 4.1));
+  EXPECT_FALSE(w.occluded(r, 3.9));
+  EXPECT_FALSE(w.occluded(Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, -1)),
+                          INFINITY));
+}
+
+namespace {
+// One of each primitive plus a BVH group, for comparing the specialised
+// queries against the full intersection list.
+struct MixedScene {
+  MixedScene() {
+    sphere->set_transform(CreateTranslation(-3, 0, 0));
+    cube->set_transform(CreateTranslation(3, 0, 0) *
+                        CreateScaling(0.5, 2, 0.5));
+    plane->set_transform(CreateTranslation(0, -3, 0));
+    for (int i = 0; i < 20; ++i) {
+      auto s = std::make_shared<Sphere>();
+      s->set_transform(CreateTranslation(i - 10, 5, i % 4) *
+                       CreateScaling(0.3, 0.3, 0.3));
+      group->add(s.get());
+      balls.push_back(s);
+    }
+    BVHBuilder().build(group.get());
+    group->build_wide_bvh(4);
+
+    for (Shape* s : std::initializer_list<Shape*>{
+             sphere.get(), cube.get(), plane.get(), tri.get(), smooth.get(),
+             group.get()}) {
+      world.add(s);
+    }
+  }
+
+  Ray ray(int i) const {
+    auto origin = Tuple::point((i % 13) - 6, (i % 7) - 2, -10 + (i % 3));
+    auto target = Tuple::point((i % 11) - 5, (i % 9) - 3, (i % 5));
+    return Ray(origin, (target - origin).normalize());
+  }
+
+  std::shared_ptr<Sphere> sphere = std::make_shared<Sphere>();
+  std::shared_ptr<Cube> cube = std::make_shared<Cube>();
+  std::shared_ptr<Plane> plane = std::make_shared<Plane>();
+  std::shared_ptr<Triangle> tri = std::make_shared<Triangle>(
+      Tuple::point(0, 1, 2), Tuple::point(-1, -1, 2), Tuple::point(1, -1, 2));
+  std::shared_ptr<SmoothTriangle> smooth = std::make_shared<SmoothTriangle>(
+      Tuple::point(0, 3, 4), Tuple::point(-1, 1, 4), Tuple::point(1, 1, 4),
+      Tuple::vector(0, 1, 0), Tuple::vector(-1, 0, 0), Tuple::vector(1, 0, 0));
+  std::vector<std::shared_ptr<Sphere>> balls;
+  std::shared_ptr<Group> group = std::make_shared<Group>();
+  World world;
+};
+}  // namespace
+
+TEST(World, OccludedMatchesIntersect) {
+  MixedScene scene;
+  for (int i = 0; i < 200; ++i) {
+    auto r = scene.ray(i);
+    auto tmax = 4.0 + (i % 17);
+
+    auto xs = scene.world.intersect(r);
+    bool expected = std::any_of(xs.begin(), xs.end(), [&](const auto& x) {
+      return x.t() >= 0 && x.t() < tmax;
+    });
+    EXPECT_EQ(expected, scene.world.occluded(r, tmax)) << i;
+  }
+}
+
+TEST(World, ClosestHitMatchesHit) {
+  MixedScene scene;
+  std::vector<Ray> rays;
+  for (int i = 0; i < 200; ++i) {
+    rays.push_back(scene.ray(i));
+  }
+
+  std::vector<std::optional<Intersection>> hits(rays.size());
+  for (size_t i = 0; i < rays.size(); i += 8) {
+    scene.world.closest_hit<8>(&rays[i], std::min<size_t>(8, rays.size() - i),
+                               &hits[i]);
+  }
+
+  int found = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    auto expected = Hit(scene.world.intersect(rays[i]));
+    auto hit = scene.world.closest_hit(rays[i]);
+    ASSERT_EQ(expected.has_value(), hit.has_value()) << i;
+    ASSERT_EQ(expected.has_value(), hits[i].has_value()) << i;
+    if (expected) {
+      EXPECT_EQ(*expected, *hit);
+      EXPECT_EQ(*expected, *hits[i]);
+      found++;
+    }
+  }
+  EXPECT_GT(found, 0);
+}
+
+TEST(World, ColorAtComputesRefractiveIndices) {
+  auto w = World::default_world();
+  auto glass = Sphere::Glass();
+  glass->set_transform(CreateTranslation(0, 0, -3) *
+                       CreateScaling(0.5, 0.5, 0.5));
+  w.add(glass.get());
+
+  auto r = Ray(Tuple::point(0, 0, -5), Tuple::vector(0, 0, 1));
+  auto hit = w.closest_hit(r);
+  ASSERT_TRUE(hit.has_value());
+  EXPECT_EQ(glass.get(), hit->object());
+  auto comps = w.computations(*hit, r);
+  EXPECT_DOUBLE_EQ(1.0, comps.n1);
+  EXPECT_DOUBLE_EQ(1.5, comps.n2);
+
+  auto c = w.color_at(r);
+  EXPECT_FALSE(std::isnan(c.r()));
+}
+
+TEST(World, IntersectIntoMatchesIntersect) {
+  MixedScene scene;
+  IntersectionVector buffer;
+  for (int i = 0; i < 100; ++i) {
+    auto r = scene.ray(i);
+    auto expected = scene.world.intersect(r);
+    scene.world.intersect(r, &buffer);
+    ASSERT_EQ(expected.size(), buffer.size()) << i;
+    for (size_t j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(expected[j].t(), buffer[j].t());
+      EXPECT_EQ(expected[j].object(), buffer[j].object());
+    }
+  }
+}
+
+TEST(World, TracingDoesNotAllocateIntersectionLists) {
+  MixedScene scene;
+  auto glass = Sphere::Glass();
+  glass->set_transform(CreateTranslation(0, 0, -3));
+  scene.world.add(glass.get());
+  PointLight light(Tuple::point(-10, 10, -10), Color(1, 1, 1));
+  scene.world.set_light(&light);
+
+  IntersectionVector buffer;
+  auto trace = [&] {
+    for (int i = 0; i < 200; ++i) {
+      auto r = scene.ray(i);
+      scene.world.intersect(r, &buffer);
+      scene.world.closest_hit(r);
+      scene.world.occluded(r, 10);
+      scene.world.color_at(r);
+    }
+  };
+
+  // the first pass grows the reused buffers to their working size
+  trace();
+  auto before = intersection_allocations().load();
+  trace();
+  EXPECT_EQ(before, intersection_allocations().load());
+}